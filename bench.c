@@ -0,0 +1,2082 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "vsfs.h"
+
+#define BENCH_DISK_SHIFT 24 // 16 MB virtual disk
+#define BENCH_CHUNK_SIZE 4096
+#define BENCH_TRANSFER_SIZE (1 << 20)
+#define BENCH_KERNEL_FILE_SIZE (128 << 10) // Fits in the buffer cache
+#define BENCH_KERNEL_REPEAT 200
+#define BENCH_MAX_THREADS 16
+#define BENCH_THREAD_FILE_SIZE (512 << 10)
+#define BENCH_THREAD_PASSES 16
+#define BENCH_MAX_QUEUE_DEPTH 64
+#define BENCH_DISK_ROUNDS 4
+#define BENCH_DISK_FILES 64
+#define BENCH_DISK_FILE_CHUNKS 16 // 64KB files
+#define BENCH_TINY_FILE_MAX 79
+#define BENCH_DELAYED_FILES 4
+#define BENCH_DELAYED_BYTES (2 << 20) // Appended to each file
+#define BENCH_CRASH_FILES 4
+#define BENCH_CRASH_FILE_MAX (1 << 20)
+#define BENCH_CRASH_APPEND_MAX 9000
+#define BENCH_JOURNAL_MAGIC 0x4c4e524a // First int of a journal transaction as written by vsfs.c
+#define BENCH_JOURNAL_HEADER_SIZE 32   // Magic, sequence, block count, record bytes, checksum
+#define BENCH_SYNC_SNAPSHOTS 16
+#define BENCH_STRESS_ROUNDS 300
+#define BENCH_STRESS_APPEND_MAX 6000
+#define BENCH_STRESS_HOT_FILE BENCH_MAX_THREADS // Pattern of the file every reader shares
+
+double elapsedSeconds(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Time stamp counter where there is one, nanoseconds otherwise
+unsigned long long readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// Creates filename and appends size bytes to it in BENCH_CHUNK_SIZE chunks
+int createBenchFile(char *filename, int size)
+{
+    char buffer[BENCH_CHUNK_SIZE];
+    int fd;
+    int written = 0;
+
+    if (vscreate(filename) != 0)
+    {
+        return -1;
+    }
+
+    fd = vsopen(filename, MODE_APPEND);
+    while (written < size)
+    {
+        int n = size - written < BENCH_CHUNK_SIZE ? size - written : BENCH_CHUNK_SIZE;
+        for (int i = 0; i < n; i++)
+        {
+            buffer[i] = (char)(written + i);
+        }
+        if (vsappend(fd, (void *)buffer, n) != n)
+        {
+            vsclose(fd);
+            return -1;
+        }
+        written += n;
+    }
+    vsclose(fd);
+    return 0;
+}
+
+// Reads the whole file sequentially with chunkSize byte vsread calls
+void benchSequentialRead(char *filename, int chunkSize)
+{
+    char buffer[BENCH_CHUNK_SIZE];
+    struct timespec start;
+    int fd = vsopen(filename, MODE_READ);
+    int size = vssize(fd);
+    int total = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (total + chunkSize <= size)
+    {
+        if (vsread(fd, (void *)buffer, chunkSize) != chunkSize)
+        {
+            printf("read error at %d\n", total);
+            break;
+        }
+        total += chunkSize;
+    }
+    double seconds = elapsedSeconds(&start);
+    vsclose(fd);
+
+    printf("sequential read %5d B chunks: %8.3f s %8.2f MB/s\n",
+           chunkSize, seconds, total / seconds / (1 << 20));
+}
+
+// Appends and reads back a file in 1 MB transfers, reporting system calls per transfer
+void benchLargeTransfers(int transferCount)
+{
+    char *buffer = malloc(BENCH_TRANSFER_SIZE);
+    struct vsIoStats stats;
+    struct timespec start;
+    double seconds;
+    memset(buffer, 'y', BENCH_TRANSFER_SIZE);
+
+    vscreate("transfer.bin");
+    int fd = vsopen("transfer.bin", MODE_APPEND);
+    vsresetstats();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < transferCount; i++)
+    {
+        vsappend(fd, (void *)buffer, BENCH_TRANSFER_SIZE);
+    }
+    vsclose(fd);
+    seconds = elapsedSeconds(&start);
+    vsgetiostats(&stats);
+    printf("1 MB appends: %8.2f MB/s %6.1f write calls per MB\n",
+           transferCount / seconds, (double)stats.writeCalls / transferCount);
+
+    fd = vsopen("transfer.bin", MODE_READ);
+    vsresetstats();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < transferCount; i++)
+    {
+        vsread(fd, (void *)buffer, BENCH_TRANSFER_SIZE);
+    }
+    seconds = elapsedSeconds(&start);
+    vsclose(fd);
+    vsgetiostats(&stats);
+    printf("1 MB reads:   %8.2f MB/s %6.1f read calls per MB\n",
+           transferCount / seconds, (double)stats.readCalls / transferCount);
+    free(buffer);
+}
+
+// Appends to two files alternately and prints how many extents they ended up in
+void benchInterleavedAppend(int appendSize, int appendCount)
+{
+    char *buffer = malloc(appendSize);
+    memset(buffer, 'x', appendSize);
+    vscreate("interleaved1.bin");
+    vscreate("interleaved2.bin");
+    int fd1 = vsopen("interleaved1.bin", MODE_APPEND);
+    int fd2 = vsopen("interleaved2.bin", MODE_APPEND);
+
+    for (int i = 0; i < appendCount; i++)
+    {
+        vsappend(fd1, (void *)buffer, appendSize);
+        vsappend(fd2, (void *)buffer, appendSize);
+    }
+
+    vsclose(fd1);
+    vsclose(fd2);
+    free(buffer);
+    vsfragreport();
+}
+
+// Checksums the whole file with copying reads and with zero-copy views
+void benchViewChecksum(char *filename, int chunkSize)
+{
+    char *buffer = malloc(chunkSize);
+    struct timespec start;
+    unsigned long checksum = 0;
+    int fd = vsopen(filename, MODE_READ);
+    int size = vssize(fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int total = 0; total + chunkSize <= size; total += chunkSize)
+    {
+        vsread(fd, (void *)buffer, chunkSize);
+        for (int i = 0; i < chunkSize; i++)
+        {
+            checksum += (unsigned char)buffer[i];
+        }
+    }
+    double copySeconds = elapsedSeconds(&start);
+    vsclose(fd);
+
+    fd = vsopen(filename, MODE_READ);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int total = 0; total + chunkSize <= size; total += chunkSize)
+    {
+        struct iovec *iov;
+        int cnt;
+        vsreadview(fd, chunkSize, &iov, &cnt);
+        for (int j = 0; j < cnt; j++)
+        {
+            for (size_t i = 0; i < iov[j].iov_len; i++)
+            {
+                checksum -= ((unsigned char *)iov[j].iov_base)[i];
+            }
+        }
+        vsreleaseview(fd);
+    }
+    double viewSeconds = elapsedSeconds(&start);
+    vsclose(fd);
+    free(buffer);
+
+    printf("checksum %6d B chunks: vsread %8.2f MB/s, vsreadview %8.2f MB/s%s\n", chunkSize,
+           size / copySeconds / (1 << 20), size / viewSeconds / (1 << 20), checksum == 0 ? "" : " (MISMATCH)");
+}
+
+// Cycles per byte of cached vsread/vsappend calls, starting offset aligned or not
+void benchCopyKernel(int chunkSize, int startOffset)
+{
+    char buffer[BENCH_CHUNK_SIZE];
+    unsigned long long readCycles = 0;
+    unsigned long long writeCycles = 0;
+    long long readBytes = 0;
+    long long writeBytes = 0;
+    memset(buffer, 'z', sizeof(buffer));
+
+    for (int r = 0; r < BENCH_KERNEL_REPEAT; r++)
+    {
+        vscreate("kernel.bin");
+        int fd = vsopen("kernel.bin", MODE_APPEND);
+        vsappend(fd, (void *)buffer, startOffset > 0 ? startOffset : chunkSize);
+        unsigned long long start = readCycleCounter();
+        int size = startOffset > 0 ? startOffset : chunkSize;
+        while (size + chunkSize <= BENCH_KERNEL_FILE_SIZE)
+        {
+            vsappend(fd, (void *)buffer, chunkSize);
+            size += chunkSize;
+        }
+        writeCycles += readCycleCounter() - start;
+        writeBytes += size - (startOffset > 0 ? startOffset : chunkSize);
+        vsclose(fd);
+
+        fd = vsopen("kernel.bin", MODE_READ);
+        vsread(fd, (void *)buffer, startOffset > 0 ? startOffset : chunkSize);
+        start = readCycleCounter();
+        int position = startOffset > 0 ? startOffset : chunkSize;
+        while (position + chunkSize <= size)
+        {
+            vsread(fd, (void *)buffer, chunkSize);
+            position += chunkSize;
+        }
+        readCycles += readCycleCounter() - start;
+        readBytes += position - (startOffset > 0 ? startOffset : chunkSize);
+        vsclose(fd);
+        vsdelete("kernel.bin");
+    }
+
+    printf("%5d B chunks at offset %d: read %6.2f cycles/B, append %6.2f cycles/B\n",
+           chunkSize, startOffset, (double)readCycles / readBytes, (double)writeCycles / writeBytes);
+}
+
+struct benchThreadArgs
+{
+    char filename[30];
+    int fd;
+    int chunkCount;
+    long long bytesRead;
+};
+
+// Reads chunkCount BENCH_CHUNK_SIZE chunks through fd, opening filename if fd is -1
+void *benchReaderThread(void *arg)
+{
+    struct benchThreadArgs *args = (struct benchThreadArgs *)arg;
+    char buffer[BENCH_CHUNK_SIZE];
+    int fd = (args->fd == -1) ? vsopen(args->filename, MODE_READ) : args->fd;
+
+    for (int i = 0; i < args->chunkCount; i++)
+    {
+        if (vsread(fd, (void *)buffer, BENCH_CHUNK_SIZE) != BENCH_CHUNK_SIZE)
+        {
+            printf("read error in %s\n", args->filename);
+            break;
+        }
+        args->bytesRead += BENCH_CHUNK_SIZE;
+    }
+
+    if (args->fd == -1)
+    {
+        vsclose(fd);
+    }
+    return NULL;
+}
+
+// Aggregate read throughput of threadCount readers on their own files, sharing one descriptor (sharedFile 1)
+// or reading one file through their own descriptors (sharedFile 2)
+void benchThreadScaling(int threadCount, int sharedFile)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    struct benchThreadArgs args[BENCH_MAX_THREADS];
+    struct timespec start;
+    long long total = 0;
+
+    // Threads sharing a descriptor share its cursor and split the file
+    int chunksPerFile = BENCH_THREAD_FILE_SIZE / BENCH_CHUNK_SIZE;
+    for (int i = 0; i < threadCount; i++)
+    {
+        sprintf(args[i].filename, "thread%d.bin", sharedFile ? 0 : i);
+        args[i].chunkCount = (sharedFile == 1) ? chunksPerFile / threadCount : chunksPerFile;
+        args[i].bytesRead = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int pass = 0; pass < BENCH_THREAD_PASSES; pass++)
+    {
+        int sharedFd = (sharedFile == 1) ? vsopen("thread0.bin", MODE_READ) : -1;
+        for (int i = 0; i < threadCount; i++)
+        {
+            args[i].fd = sharedFd;
+            pthread_create(&threads[i], NULL, benchReaderThread, &args[i]);
+        }
+        for (int i = 0; i < threadCount; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        if (sharedFd != -1)
+        {
+            vsclose(sharedFd);
+        }
+    }
+    double seconds = elapsedSeconds(&start);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        total += args[i].bytesRead;
+    }
+    char *labels[] = {"own files", "one fd", "own fds"};
+    printf("%2d threads %-9s: %8.3f s %8.2f MB/s\n", threadCount, labels[sharedFile], seconds, total / seconds / (1 << 20));
+}
+
+int prepareDisk(char *vdiskname, int mountMode)
+{
+    if (vsformat(vdiskname, BENCH_DISK_SHIFT) != 0 || vsmountmode(vdiskname, mountMode) != 0)
+    {
+        printf("could not prepare the disk\n");
+        return -1;
+    }
+    return 0;
+}
+
+// The workload of app.c: many tiny appends to three files, then a byte by byte read
+void benchAppWorkload(char *vdiskname, int mountMode)
+{
+    char buffer[8] = {65, 66, 67, 68, 50, 50, 50, 50};
+    struct timespec start;
+    double appendSeconds;
+    double readSeconds;
+
+    if (prepareDisk(vdiskname, mountMode) != 0)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    vscreate("file1.bin");
+    vscreate("file2.bin");
+    vscreate("file3.bin");
+    int fd1 = vsopen("file1.bin", MODE_APPEND);
+    int fd2 = vsopen("file2.bin", MODE_APPEND);
+    int fd3 = vsopen("file3.bin", MODE_APPEND);
+    for (int i = 0; i < 10000; i++)
+    {
+        vsappend(fd1, (void *)buffer, 1);
+        vsappend(fd2, (void *)buffer, 4);
+        vsappend(fd3, (void *)buffer, 8);
+    }
+    vsclose(fd1);
+    vsclose(fd2);
+    vsclose(fd3);
+    appendSeconds = elapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fd3 = vsopen("file3.bin", MODE_READ);
+    int size = vssize(fd3);
+    for (int i = 0; i < size; i++)
+    {
+        vsread(fd3, (void *)buffer, 1);
+    }
+    vsclose(fd3);
+    readSeconds = elapsedSeconds(&start);
+    vsumount();
+
+    printf("%-5s backend: appends %8.3f s, byte reads %8.3f s\n",
+           mountMode == MOUNT_MMAP ? "mmap" : "fd", appendSeconds, readSeconds);
+}
+
+// Write system calls of the app.c append workload, including unmount, under a flush policy
+void benchMetadataFlush(char *vdiskname, int policy)
+{
+    char *policyNames[4] = {"immediate", "on close", "periodic", "on sync"};
+    char buffer[8] = {65, 66, 67, 68, 50, 50, 50, 50};
+    struct timespec start;
+    struct vsIoStats stats;
+
+    if (prepareDisk(vdiskname, MOUNT_FD) != 0 || vssetflushpolicy(policy, 100) != 0)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    vscreate("file1.bin");
+    vscreate("file2.bin");
+    vscreate("file3.bin");
+    int fd1 = vsopen("file1.bin", MODE_APPEND);
+    int fd2 = vsopen("file2.bin", MODE_APPEND);
+    int fd3 = vsopen("file3.bin", MODE_APPEND);
+    for (int i = 0; i < 10000; i++)
+    {
+        vsappend(fd1, (void *)buffer, 1);
+        vsappend(fd2, (void *)buffer, 4);
+        vsappend(fd3, (void *)buffer, 8);
+    }
+    vsclose(fd1);
+    vsclose(fd2);
+    vsclose(fd3);
+    vsumount();
+    double seconds = elapsedSeconds(&start);
+
+    vsgetiostats(&stats);
+    printf("flush %-9s: %8.3f s %8ld write calls %10lld bytes written\n",
+           policyNames[policy], seconds, stats.writeCalls, stats.bytesWritten);
+}
+
+// Opens and closes fileCount files round robin, the lookups go through the filename index
+void benchOpenChurn(int fileCount, int rounds)
+{
+    char filename[30];
+    struct timespec start;
+
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "churn%d.bin", i);
+        if (vscreate(filename) != 0)
+        {
+            return;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < fileCount; i++)
+        {
+            sprintf(filename, "churn%d.bin", i);
+            int fd = vsopen(filename, MODE_READ);
+            if (fd == -1 || vsclose(fd) != 0)
+            {
+                printf("open error on %s\n", filename);
+                return;
+            }
+        }
+    }
+    double seconds = elapsedSeconds(&start);
+
+    printf("open/close %4d files: %8.3f s %10.0f pairs/s\n",
+           fileCount, seconds, (double)fileCount * rounds / seconds);
+}
+
+// Opens descriptorCount descriptors on one file, reads a chunk through each, then closes every other one and reopens
+void benchDescriptorTable(int descriptorCount)
+{
+    char buffer[BENCH_CHUNK_SIZE];
+    struct timespec start;
+    int *fds = malloc(descriptorCount * sizeof(int));
+
+    if (createBenchFile("hot.bin", BENCH_THREAD_FILE_SIZE) != 0)
+    {
+        free(fds);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < descriptorCount; i++)
+    {
+        fds[i] = vsopen("hot.bin", MODE_READ);
+        if (fds[i] == -1)
+        {
+            printf("open error after %d descriptors\n", i);
+            descriptorCount = i;
+            break;
+        }
+    }
+    double openSeconds = elapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int chunks = BENCH_THREAD_FILE_SIZE / BENCH_CHUNK_SIZE;
+    for (int i = 0; i < descriptorCount; i++)
+    {
+        if (vspread(fds[i], buffer, BENCH_CHUNK_SIZE, (i % chunks) * BENCH_CHUNK_SIZE) != BENCH_CHUNK_SIZE)
+        {
+            printf("read error on descriptor %d\n", fds[i]);
+            break;
+        }
+    }
+    double readSeconds = elapsedSeconds(&start);
+
+    // Closed descriptors go back on the free list and are handed out again
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < descriptorCount; i += 2)
+    {
+        vsclose(fds[i]);
+        fds[i] = vsopen("hot.bin", MODE_READ);
+    }
+    double churnSeconds = elapsedSeconds(&start);
+
+    for (int i = 0; i < descriptorCount; i++)
+    {
+        vsclose(fds[i]);
+    }
+    free(fds);
+    vsdelete("hot.bin");
+
+    printf("%7d descriptors on one file: open %6.2f us, read %6.2f us, close+open %6.2f us per descriptor\n",
+           descriptorCount, openSeconds * 1e6 / descriptorCount, readSeconds * 1e6 / descriptorCount,
+           churnSeconds * 1e6 / ((descriptorCount + 1) / 2));
+}
+
+// Creates, lookups and a remount as the directory grows past its initial blocks
+void benchDirectoryScaling(char *vdiskname, int fileCount)
+{
+    char filename[30];
+    struct timespec start;
+
+    if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "dir%d.bin", i);
+        if (vscreate(filename) != 0)
+        {
+            printf("create error on %s\n", filename);
+            vsumount();
+            return;
+        }
+    }
+    double createSeconds = elapsedSeconds(&start);
+
+    vsumount();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (vsmount(vdiskname) != 0)
+    {
+        return;
+    }
+    double mountSeconds = elapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "dir%d.bin", i);
+        int fd = vsopen(filename, MODE_READ);
+        if (fd == -1 || vsclose(fd) != 0)
+        {
+            printf("open error on %s\n", filename);
+            vsumount();
+            return;
+        }
+    }
+    double lookupSeconds = elapsedSeconds(&start);
+    vsumount();
+
+    printf("%5d files: create %10.0f files/s, mount %8.3f ms, open/close %10.0f pairs/s\n", fileCount,
+           fileCount / createSeconds, mountSeconds * 1000, fileCount / lookupSeconds);
+}
+
+// Opens through paths of growing depth, every directory on the way also holds other files
+void benchPathLookup(char *vdiskname, int depth, int rounds)
+{
+    char path[1024];
+    char filename[1100];
+    struct timespec start;
+
+    if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+    {
+        return;
+    }
+
+    path[0] = '\0';
+    for (int level = 0; level < depth; level++)
+    {
+        sprintf(path + strlen(path), "%slevel%d", level == 0 ? "" : "/", level);
+        if (vsmkdir(path) != 0)
+        {
+            printf("mkdir error on %s\n", path);
+            vsumount();
+            return;
+        }
+        for (int i = 0; i < 32; i++)
+        {
+            sprintf(filename, "%s/other%d.bin", path, i);
+            vscreate(filename);
+        }
+    }
+    sprintf(filename, "%s/target.bin", path);
+    if (vscreate(filename) != 0)
+    {
+        vsumount();
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < rounds; round++)
+    {
+        int fd = vsopen(filename, MODE_READ);
+        if (fd == -1 || vsclose(fd) != 0)
+        {
+            printf("open error on %s\n", filename);
+            vsumount();
+            return;
+        }
+    }
+    double seconds = elapsedSeconds(&start);
+    vsumount();
+
+    printf("depth %2d: %8.3f s %10.0f open/close pairs/s\n", depth, seconds, rounds / seconds);
+}
+
+// Resident set size of the process from /proc, 0 if it can not be read
+long readResidentKilobytes()
+{
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+    {
+        return 0;
+    }
+    if (fscanf(statm, "%*s %ld", &pages) != 1)
+    {
+        pages = 0;
+    }
+    fclose(statm);
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Mount time and memory of a disk of 2^shift bytes holding one small file
+void benchDiskSize(char *vdiskname, int shift)
+{
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (vsformat(vdiskname, shift) != 0)
+    {
+        return;
+    }
+    double formatSeconds = elapsedSeconds(&start);
+
+    if (vsmount(vdiskname) != 0 || createBenchFile("size.bin", 1 << 20) != 0)
+    {
+        return;
+    }
+    vsumount();
+
+    long residentBefore = readResidentKilobytes();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (vsmount(vdiskname) != 0)
+    {
+        return;
+    }
+    double mountSeconds = elapsedSeconds(&start);
+    long residentAfter = readResidentKilobytes();
+    vsumount();
+
+    printf("%6lld MB: format %8.3f s, mount %8.3f ms, mount RSS %+6ld KB\n", (1LL << shift) >> 20,
+           formatSeconds, mountSeconds * 1000, residentAfter - residentBefore);
+}
+
+// Mount, open and read the first block of one file on a disk full of interleaved files
+void benchFirstRead(char *vdiskname, int shift, int fileCount, int fileSize)
+{
+    char filename[30];
+    char buffer[BENCH_CHUNK_SIZE];
+    static char chunk[BENCH_TRANSFER_SIZE / 16];
+    struct timespec start;
+
+    if (vsformat(vdiskname, shift) != 0 || vsmount(vdiskname) != 0)
+    {
+        return;
+    }
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "first%d.bin", i);
+        vscreate(filename);
+    }
+
+    // Round robin appends spread every chain over the whole used part of the disk
+    for (int written = 0; written < fileSize; written += sizeof(chunk))
+    {
+        for (int i = 0; i < fileCount; i++)
+        {
+            sprintf(filename, "first%d.bin", i);
+            int fd = vsopen(filename, MODE_APPEND);
+            if (fd == -1 || vsappend(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+            {
+                printf("append error on %s\n", filename);
+                vsumount();
+                return;
+            }
+            vsclose(fd);
+        }
+    }
+    vsumount();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (vsmount(vdiskname) != 0)
+    {
+        return;
+    }
+    double mountSeconds = elapsedSeconds(&start);
+    int fd = vsopen("first0.bin", MODE_READ);
+    if (fd == -1 || vsread(fd, buffer, sizeof(buffer)) != sizeof(buffer))
+    {
+        printf("read error on first0.bin\n");
+        vsumount();
+        return;
+    }
+    double firstReadSeconds = elapsedSeconds(&start);
+    vsclose(fd);
+    vsumount();
+
+    printf("%4d files of %4d MB: mount %8.3f ms, first read after mount %8.3f ms\n", fileCount, fileSize >> 20,
+           mountSeconds * 1000, firstReadSeconds * 1000);
+}
+
+// Random BENCH_CHUNK_SIZE vspread calls into one file, the first pass also builds its skip index
+void benchRandomRead(char *vdiskname, int fileSize, int readCount)
+{
+    static char chunk[BENCH_TRANSFER_SIZE];
+    char buffer[BENCH_CHUNK_SIZE];
+    struct timespec start;
+
+    if (vsformat(vdiskname, 30) != 0 || vsmount(vdiskname) != 0 || vscreate("random.bin") != 0)
+    {
+        return;
+    }
+    int fd = vsopen("random.bin", MODE_APPEND);
+    for (int written = 0; written < fileSize; written += sizeof(chunk))
+    {
+        if (vsappend(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+        {
+            printf("append error\n");
+            vsclose(fd);
+            vsumount();
+            return;
+        }
+    }
+    vsclose(fd);
+
+    fd = vsopen("random.bin", MODE_READ);
+    double seconds[2];
+    srand(fileSize);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < readCount; i++)
+        {
+            int offset = (rand() % (fileSize / BENCH_CHUNK_SIZE)) * BENCH_CHUNK_SIZE;
+            if (vspread(fd, buffer, sizeof(buffer), offset) != sizeof(buffer))
+            {
+                printf("read error at %d\n", offset);
+                break;
+            }
+        }
+        seconds[pass] = elapsedSeconds(&start);
+    }
+    vsclose(fd);
+    vsumount();
+
+    printf("%4d MB file: %d random %d B reads, first pass %8.2f us/read, second pass %8.2f us/read\n", fileSize >> 20,
+           readCount, BENCH_CHUNK_SIZE, seconds[0] * 1e6 / readCount, seconds[1] * 1e6 / readCount);
+}
+
+// Sequential appends and reads of one file, then many small files, on a disk formatted with blockSize
+void benchBlockSize(char *vdiskname, int blockSize, int fileSize)
+{
+    static char chunk[BENCH_TRANSFER_SIZE / 16];
+    char small[BENCH_CHUNK_SIZE];
+    struct vsIoStats stats;
+    struct timespec start;
+
+    if (vsformatmode(vdiskname, 28, FORMAT_SPARSE, blockSize) != 0 || vsmount(vdiskname) != 0 ||
+        vscreate("blocks.bin") != 0)
+    {
+        return;
+    }
+    int fd = vsopen("blocks.bin", MODE_APPEND);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int written = 0; written < fileSize; written += sizeof(chunk))
+    {
+        if (vsappend(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+        {
+            printf("append error\n");
+            vsclose(fd);
+            vsumount();
+            return;
+        }
+    }
+    vsclose(fd);
+    vssync();
+    double appendSeconds = elapsedSeconds(&start);
+    vsumount();
+
+    // Cold reads after a remount, in large chunks and in small ones
+    double readSeconds[2];
+    long readCalls[2];
+    int chunkSizes[2] = {sizeof(chunk), sizeof(small)};
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (vsmount(vdiskname) != 0)
+        {
+            return;
+        }
+        fd = vsopen("blocks.bin", MODE_READ);
+        vsresetstats();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int total = 0; total < fileSize; total += chunkSizes[pass])
+        {
+            if (vsread(fd, pass == 0 ? chunk : small, chunkSizes[pass]) != chunkSizes[pass])
+            {
+                printf("read error at %d\n", total);
+                break;
+            }
+        }
+        readSeconds[pass] = elapsedSeconds(&start);
+        vsgetiostats(&stats);
+        readCalls[pass] = stats.readCalls;
+        vsclose(fd);
+        vsumount();
+    }
+
+    // Every small file takes at least one block
+    char filename[30];
+    int smallFiles = 0;
+    if (vsmount(vdiskname) != 0)
+    {
+        return;
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        sprintf(filename, "small%d", i);
+        if (vscreate(filename) != 0)
+        {
+            break;
+        }
+        fd = vsopen(filename, MODE_APPEND);
+        vsappend(fd, small, 100);
+        vsclose(fd);
+        smallFiles++;
+    }
+    vsumount();
+
+    printf("%5d B blocks: append %8.2f MB/s, read %4d KB chunks %8.2f MB/s (%6ld calls), read %d B chunks %8.2f MB/s (%6ld calls), %4d files of 100 B use %6d KB\n",
+           blockSize, fileSize / appendSeconds / (1 << 20), (int)sizeof(chunk) >> 10, fileSize / readSeconds[0] / (1 << 20), readCalls[0],
+           (int)sizeof(small), fileSize / readSeconds[1] / (1 << 20), readCalls[1], smallFiles, (int)((long)smallFiles * blockSize >> 10));
+}
+
+// Random reads with queueDepth asynchronous requests outstanding, the cache is cold for each depth
+void benchAsyncRead(char *vdiskname, int backend, int fileSize, int readCount)
+{
+    static char chunk[BENCH_TRANSFER_SIZE];
+    static char buffers[BENCH_MAX_QUEUE_DEPTH][BENCH_CHUNK_SIZE];
+    struct vsCompletion completions[BENCH_MAX_QUEUE_DEPTH];
+    struct timespec start;
+
+    vssetasyncbackend(backend);
+    if (vsformat(vdiskname, 30) != 0 || vsmount(vdiskname) != 0 || vscreate("async.bin") != 0)
+    {
+        return;
+    }
+    int fd = vsopen("async.bin", MODE_APPEND);
+    for (int written = 0; written < fileSize; written += sizeof(chunk))
+    {
+        if (vsappend(fd, chunk, sizeof(chunk)) != sizeof(chunk))
+        {
+            printf("append error\n");
+            vsclose(fd);
+            vsumount();
+            return;
+        }
+    }
+    vsclose(fd);
+    vsumount();
+
+    srand(fileSize);
+    for (int queueDepth = 1; queueDepth <= BENCH_MAX_QUEUE_DEPTH; queueDepth *= 2)
+    {
+        if (vsmount(vdiskname) != 0)
+        {
+            return;
+        }
+        fd = vsopen("async.bin", MODE_READ);
+
+        // Each completion hands its buffer to the next request
+        int submitted = 0;
+        int completed = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (completed < readCount)
+        {
+            while (submitted < readCount && submitted - completed < queueDepth)
+            {
+                int offset = (rand() % (fileSize / BENCH_CHUNK_SIZE)) * BENCH_CHUNK_SIZE;
+                long slot = submitted % queueDepth;
+                if (vsreadasync(fd, buffers[slot], BENCH_CHUNK_SIZE, offset, (void *)slot) != 0)
+                {
+                    printf("submit error at %d\n", offset);
+                    vsclose(fd);
+                    vsumount();
+                    return;
+                }
+                submitted++;
+            }
+
+            int count = vswait(completions, queueDepth, 1);
+            for (int i = 0; i < count; i++)
+            {
+                if (completions[i].result != BENCH_CHUNK_SIZE)
+                {
+                    printf("read error\n");
+                }
+            }
+            completed += count;
+        }
+        double seconds = elapsedSeconds(&start);
+        int used = vsgetasyncbackend();
+        vsclose(fd);
+        vsumount();
+
+        printf("%-11s queue depth %2d: %d random %d B reads, %8.2f us/read, %8.0f reads/s\n",
+               used == ASYNC_IO_URING ? "io_uring" : "thread pool", queueDepth, readCount, BENCH_CHUNK_SIZE,
+               seconds * 1e6 / readCount, readCount / seconds);
+    }
+}
+
+struct benchDiskArgs
+{
+    vsfs_t *fs;
+    int index;
+    int failed;
+};
+
+// Creates, fills, reads back and deletes files of its own on args->fs
+void *benchDiskThread(void *arg)
+{
+    struct benchDiskArgs *args = (struct benchDiskArgs *)arg;
+    char buffer[BENCH_CHUNK_SIZE];
+    char filename[30];
+
+    memset(buffer, args->index, sizeof(buffer));
+    for (int round = 0; round < BENCH_DISK_ROUNDS; round++)
+    {
+        for (int i = 0; i < BENCH_DISK_FILES; i++)
+        {
+            sprintf(filename, "t%d_%d", args->index, i);
+            if (vsfscreate(args->fs, filename) != 0)
+            {
+                args->failed = 1;
+                return NULL;
+            }
+            int fd = vsfsopen(args->fs, filename, MODE_APPEND);
+            for (int k = 0; k < BENCH_DISK_FILE_CHUNKS; k++)
+            {
+                args->failed |= vsfsappend(args->fs, fd, buffer, sizeof(buffer)) != sizeof(buffer);
+            }
+            vsfsclose(args->fs, fd);
+
+            fd = vsfsopen(args->fs, filename, MODE_READ);
+            for (int k = 0; k < BENCH_DISK_FILE_CHUNKS; k++)
+            {
+                args->failed |= vsfsread(args->fs, fd, buffer, sizeof(buffer)) != sizeof(buffer);
+            }
+            vsfsclose(args->fs, fd);
+        }
+        for (int i = 0; i < BENCH_DISK_FILES; i++)
+        {
+            sprintf(filename, "t%d_%d", args->index, i);
+            args->failed |= vsfsdelete(args->fs, filename) != 0;
+        }
+    }
+    return NULL;
+}
+
+// threadCount threads with a disk each, or all on one disk, each thread on files of its own
+void benchDiskScaling(char *vdiskname, int threadCount, int ownDisks)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    struct benchDiskArgs args[BENCH_MAX_THREADS];
+    char filename[220];
+    struct timespec start;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        sprintf(filename, "%s.%d", vdiskname, i);
+        if (i == 0 || ownDisks)
+        {
+            if (vsformat(filename, BENCH_DISK_SHIFT + 2) != 0)
+            {
+                return;
+            }
+            args[i].fs = vsfsmount(filename, MOUNT_FD);
+            if (args[i].fs == NULL)
+            {
+                return;
+            }
+        }
+        else
+        {
+            args[i].fs = args[0].fs;
+        }
+        args[i].index = i;
+        args[i].failed = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_create(&threads[i], NULL, benchDiskThread, &args[i]);
+    }
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = elapsedSeconds(&start);
+
+    int failed = 0;
+    for (int i = 0; i < threadCount; i++)
+    {
+        failed |= args[i].failed;
+        if (i == 0 || ownDisks)
+        {
+            vsfsumount(args[i].fs);
+            sprintf(filename, "%s.%d", vdiskname, i);
+            unlink(filename);
+        }
+    }
+
+    int files = threadCount * BENCH_DISK_ROUNDS * BENCH_DISK_FILES;
+    printf("%2d threads %-9s: %8.3f s %9.0f files/s%s\n", threadCount, ownDisks ? "own disks" : "one disk", seconds,
+           files / seconds, failed ? " (errors)" : "");
+}
+
+// Creates fileCount files of 0 to 78 bytes, then reads them back after a remount
+void benchTinyFiles(char *vdiskname, int fileCount)
+{
+    char buffer[BENCH_TINY_FILE_MAX];
+    char filename[30];
+    struct vsIoStats stats;
+    struct timespec start;
+
+    memset(buffer, 't', sizeof(buffer));
+    vssetflushpolicy(FLUSH_ON_SYNC, 0);
+    if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "tiny%d", i);
+        if (vscreate(filename) != 0)
+        {
+            printf("create error\n");
+            break;
+        }
+        int fd = vsopen(filename, MODE_APPEND);
+        if (i % BENCH_TINY_FILE_MAX > 0)
+        {
+            vsappend(fd, buffer, i % BENCH_TINY_FILE_MAX);
+        }
+        vsclose(fd);
+    }
+    vssync();
+    double createSeconds = elapsedSeconds(&start);
+    vsgetiostats(&stats);
+    vsumount();
+
+    vsmount(vdiskname);
+    vsresetstats();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < fileCount; i++)
+    {
+        sprintf(filename, "tiny%d", i);
+        int fd = vsopen(filename, MODE_READ);
+        int size = vssize(fd);
+        if (size > 0 && vsread(fd, buffer, size) != size)
+        {
+            printf("read error\n");
+        }
+        vsclose(fd);
+    }
+    double readSeconds = elapsedSeconds(&start);
+    struct vsIoStats readStats;
+    vsgetiostats(&readStats);
+    vsumount();
+    vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+
+    printf("%d files of 0-%d B: create %8.2f us/file, %ld writes %lld KB; read %8.2f us/file, %ld reads %lld KB\n",
+           fileCount, BENCH_TINY_FILE_MAX - 1, createSeconds * 1e6 / fileCount, stats.writeCalls, stats.bytesWritten >> 10,
+           readSeconds * 1e6 / fileCount, readStats.readCalls, readStats.bytesRead >> 10);
+}
+
+// Interleaves small appends to a few files, written through on every append or held back and allocated in batches
+void benchDelayedAppend(char *vdiskname, int policy, int appendSize)
+{
+    char *buffer = malloc(appendSize);
+    char filename[30];
+    int fds[BENCH_DELAYED_FILES];
+    struct vsIoStats stats;
+    struct timespec start;
+
+    memset(buffer, 'd', appendSize);
+    vssetflushpolicy(policy, 0);
+    if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+    {
+        free(buffer);
+        return;
+    }
+    for (int i = 0; i < BENCH_DELAYED_FILES; i++)
+    {
+        sprintf(filename, "delayed%d", i);
+        vscreate(filename);
+        fds[i] = vsopen(filename, MODE_APPEND);
+    }
+
+    vsresetstats();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int written = 0; written < BENCH_DELAYED_BYTES; written += appendSize)
+    {
+        for (int i = 0; i < BENCH_DELAYED_FILES; i++)
+        {
+            if (vsappend(fds[i], buffer, appendSize) != appendSize)
+            {
+                printf("append error\n");
+            }
+        }
+    }
+    for (int i = 0; i < BENCH_DELAYED_FILES; i++)
+    {
+        vsclose(fds[i]);
+    }
+    vssync();
+    double seconds = elapsedSeconds(&start);
+    vsgetiostats(&stats);
+
+    printf("%s, %d B appends: %8.3f s %8.2f MB/s, %ld writes %lld KB\n",
+           policy == FLUSH_IMMEDIATE ? "written through" : "delayed allocation", appendSize, seconds,
+           BENCH_DELAYED_FILES * (BENCH_DELAYED_BYTES / 1048576.0) / seconds, stats.writeCalls, stats.bytesWritten >> 10);
+    vsfragreport();
+    vsumount();
+    vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+    free(buffer);
+}
+
+unsigned char crashPattern(int file, int offset)
+{
+    return (unsigned char)((offset * 7 + file * 31) & 255);
+}
+
+// Appends to BENCH_CRASH_FILES files until killed, each append is durable under FLUSH_IMMEDIATE once it returns.
+// Every file, size pair is reported through reportFd after it is durable, a size of -1 announces a delete.
+void runCrashWorkload(char *vdiskname, int reportFd, int seed)
+{
+    static unsigned char buffer[BENCH_CRASH_APPEND_MAX];
+    int sizes[BENCH_CRASH_FILES] = {0};
+    char filename[30];
+
+    srand(seed);
+    vssetflushpolicy(FLUSH_IMMEDIATE, 0);
+    if (vsmount(vdiskname) != 0)
+    {
+        _exit(1);
+    }
+    for (int f = 0; f < BENCH_CRASH_FILES; f++)
+    {
+        sprintf(filename, "crash%d", f);
+        vscreate(filename);
+    }
+
+    for (;;)
+    {
+        int f = rand() % BENCH_CRASH_FILES;
+        int n = 1 + rand() % BENCH_CRASH_APPEND_MAX;
+        int report[2] = {f, -1};
+        sprintf(filename, "crash%d", f);
+        if (sizes[f] + n > BENCH_CRASH_FILE_MAX)
+        {
+            write(reportFd, report, sizeof(report));
+            vsdelete(filename);
+            vscreate(filename);
+            sizes[f] = 0;
+            report[1] = 0;
+            write(reportFd, report, sizeof(report));
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            buffer[i] = crashPattern(f, sizes[f] + i);
+        }
+        int fd = vsopen(filename, MODE_APPEND);
+        if (vsappend(fd, buffer, n) == n)
+        {
+            sizes[f] += n;
+            report[1] = sizes[f];
+            write(reportFd, report, sizeof(report));
+        }
+        vsclose(fd);
+    }
+}
+
+// Checks the files after a crash, each holds at least its last durable size of the pattern, exactly that with exact
+int verifyCrashFiles(char *vdiskname, int *durableSizes, int exact)
+{
+    static unsigned char buffer[BENCH_CRASH_FILE_MAX];
+    char filename[30];
+    int failed = 0;
+
+    if (vsmount(vdiskname) != 0)
+    {
+        printf("mount after crash failed\n");
+        return -1;
+    }
+    for (int f = 0; f < BENCH_CRASH_FILES && !failed; f++)
+    {
+        sprintf(filename, "crash%d", f);
+        int fd = vsopen(filename, MODE_READ);
+        if (fd == -1)
+        {
+            // Only a file being deleted or not created yet may be missing
+            failed = durableSizes[f] > 0;
+            continue;
+        }
+
+        int size = vssize(fd);
+        if (size < durableSizes[f] || (exact && size != durableSizes[f]) || size > BENCH_CRASH_FILE_MAX || (size > 0 && vsread(fd, buffer, size) != size))
+        {
+            printf("%s: %d bytes, %d were durable\n", filename, size, durableSizes[f]);
+            failed = 1;
+        }
+        for (int i = 0; i < size && !failed; i++)
+        {
+            if (buffer[i] != crashPattern(f, i))
+            {
+                printf("%s: wrong data at %d of %d\n", filename, i, size);
+                failed = 1;
+            }
+        }
+        vsclose(fd);
+    }
+
+    // Blocks leaked by the crash would be missing from a disk emptied again
+    for (int f = 0; f < BENCH_CRASH_FILES; f++)
+    {
+        sprintf(filename, "crash%d", f);
+        vsdelete(filename);
+    }
+    vsumount();
+    return failed ? -1 : 0;
+}
+
+// Bytes a file can grow to on the disk, the same on a fresh disk and on one emptied after a crash
+long long measureCapacity(char *vdiskname)
+{
+    static char buffer[65536];
+    long long total = 0;
+
+    if (vsmount(vdiskname) != 0 || vscreate("capacity") != 0)
+    {
+        return -1;
+    }
+    int fd = vsopen("capacity", MODE_APPEND);
+    while (vsappend(fd, buffer, sizeof(buffer)) == sizeof(buffer))
+    {
+        total += sizeof(buffer);
+    }
+    vsclose(fd);
+    vsdelete("capacity");
+    vsumount();
+    return total;
+}
+
+// Offset of the journal transaction with the highest sequence in a disk image, -1 if there is none
+long findLastTransaction(unsigned char *image, long size, int blockSize, int *header)
+{
+    long lastOffset = -1;
+    int lastSequence = -1;
+
+    for (long offset = 0; offset + BENCH_JOURNAL_HEADER_SIZE <= size; offset += blockSize)
+    {
+        int candidate[5];
+        memcpy(candidate, image + offset, sizeof(candidate));
+        if (candidate[0] == BENCH_JOURNAL_MAGIC && candidate[1] > lastSequence && candidate[3] > 0)
+        {
+            lastOffset = offset;
+            lastSequence = candidate[1];
+            memcpy(header, candidate, sizeof(candidate));
+        }
+    }
+    return lastOffset;
+}
+
+// Copies the whole virtual disk into memory, NULL on error
+unsigned char *readDiskImage(char *vdiskname)
+{
+    long size = 1L << BENCH_DISK_SHIFT;
+    unsigned char *image = malloc(size);
+    int fd = open(vdiskname, O_RDONLY);
+    if (image != NULL && fd != -1 && pread(fd, image, size, 0) == size)
+    {
+        close(fd);
+        return image;
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    free(image);
+    return NULL;
+}
+
+// Writes a disk image built by the crash tests back to the virtual disk
+int writeDiskImage(char *vdiskname, unsigned char *image)
+{
+    long size = 1L << BENCH_DISK_SHIFT;
+    int fd = open(vdiskname, O_WRONLY);
+    int res = (fd != -1 && pwrite(fd, image, size, 0) == size) ? 0 : -1;
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    return res;
+}
+
+// Corrupts the last byte of the journal transaction with the highest sequence, as if its write was torn
+int tearLastTransaction(char *vdiskname, int blockSize)
+{
+    int header[5];
+    unsigned char *image = readDiskImage(vdiskname);
+    if (image == NULL)
+    {
+        return -1;
+    }
+
+    long lastOffset = findLastTransaction(image, 1L << BENCH_DISK_SHIFT, blockSize, header);
+    int res = -1;
+    if (lastOffset != -1)
+    {
+        image[lastOffset + BENCH_JOURNAL_HEADER_SIZE + header[3] - 1] ^= 0xff;
+        res = writeDiskImage(vdiskname, image);
+    }
+    free(image);
+    return res;
+}
+
+// Disk images taken after every fsync of the virtual disk while syncSnapshotFd is set, the points a power
+// loss can fall back to. bench links with --wrap=fsync so the calls in vsfs.c land here.
+unsigned char *syncSnapshots[BENCH_SYNC_SNAPSHOTS];
+int syncSnapshotCount = 0;
+char *syncSnapshotDisk = NULL;
+
+int __real_fsync(int fd);
+
+int __wrap_fsync(int fd)
+{
+    int res = __real_fsync(fd);
+    if (syncSnapshotDisk != NULL && syncSnapshotCount < BENCH_SYNC_SNAPSHOTS)
+    {
+        syncSnapshots[syncSnapshotCount++] = readDiskImage(syncSnapshotDisk);
+    }
+    return res;
+}
+
+// Appends and syncs twice under FLUSH_ON_SYNC, then rebuilds the disk a power loss can leave behind: everything
+// up to the sync before the last commit, plus the commit itself but none of the data written since. Replay of
+// the commit must find the data it points at.
+int checkLostDataWrite(char *vdiskname, int *sizes)
+{
+    static unsigned char buffer[BENCH_CRASH_APPEND_MAX];
+    char filename[30];
+    int header[5];
+
+    vsformat(vdiskname, BENCH_DISK_SHIFT);
+    vssetflushpolicy(FLUSH_ON_SYNC, 0);
+    if (vsmount(vdiskname) != 0)
+    {
+        vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+        return -1;
+    }
+    for (int phase = 0; phase < 2; phase++)
+    {
+        if (phase == 1)
+        {
+            // Everything before is durable, snapshot 0 is the disk as the first phase left it
+            syncSnapshotCount = 0;
+            syncSnapshots[syncSnapshotCount++] = readDiskImage(vdiskname);
+            syncSnapshotDisk = vdiskname;
+        }
+        for (int f = 0; f < BENCH_CRASH_FILES; f++)
+        {
+            sprintf(filename, "crash%d", f);
+            int size = (phase == 0) ? 0 : 2000 + f * 2000;
+            if (phase == 0)
+            {
+                vscreate(filename);
+            }
+            for (int i = 0; i < 2000 + f * 2000; i++)
+            {
+                buffer[i] = crashPattern(f, size + i);
+            }
+            int fd = vsopen(filename, MODE_APPEND);
+            vsappend(fd, buffer, 2000 + f * 2000);
+            vsclose(fd);
+        }
+        vssync();
+    }
+    syncSnapshotDisk = NULL;
+    int blockSize = vsgetblocksize();
+    vsumount();
+    vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+
+    // The first snapshot holding the last commit follows the sync that should have made its data durable
+    int res = -1;
+    long size = 1L << BENCH_DISK_SHIFT;
+    long lastOffset = -1;
+    if (syncSnapshotCount > 1 && syncSnapshots[syncSnapshotCount - 1] != NULL)
+    {
+        lastOffset = findLastTransaction(syncSnapshots[syncSnapshotCount - 1], size, blockSize, header);
+    }
+    for (int k = 1; k < syncSnapshotCount && lastOffset != -1; k++)
+    {
+        if (syncSnapshots[k] == NULL || syncSnapshots[k - 1] == NULL)
+        {
+            break;
+        }
+        if (memcmp(syncSnapshots[k] + lastOffset, header, sizeof(header)) == 0)
+        {
+            memcpy(syncSnapshots[k - 1] + lastOffset, syncSnapshots[k] + lastOffset, (long)header[2] * blockSize);
+            res = writeDiskImage(vdiskname, syncSnapshots[k - 1]);
+            break;
+        }
+    }
+    for (int k = 0; k < syncSnapshotCount; k++)
+    {
+        free(syncSnapshots[k]);
+    }
+    syncSnapshotCount = 0;
+    return (res == 0) ? verifyCrashFiles(vdiskname, sizes, 1) : -1;
+}
+
+// Kills a process appending under FLUSH_IMMEDIATE at random points, then mounts the disk again: the journal
+// replays every committed append and no block leaks. A last round tears the final commit on purpose.
+int benchCrashRecovery(char *vdiskname, int rounds)
+{
+    int failures = 0;
+    char filename[30];
+    static unsigned char buffer[BENCH_CRASH_APPEND_MAX];
+
+    if (vsformat(vdiskname, BENCH_DISK_SHIFT) != 0)
+    {
+        return -1;
+    }
+    long long capacity = measureCapacity(vdiskname);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        int durableSizes[BENCH_CRASH_FILES] = {0};
+        int pipeFds[2];
+        int report[2];
+
+        vsformat(vdiskname, BENCH_DISK_SHIFT);
+        if (pipe(pipeFds) != 0)
+        {
+            return -1;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(pipeFds[0]);
+            runCrashWorkload(vdiskname, pipeFds[1], round);
+        }
+        close(pipeFds[1]);
+        usleep(20000 + (round * 7919) % 300000);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        while (read(pipeFds[0], report, sizeof(report)) == sizeof(report))
+        {
+            durableSizes[report[0]] = report[1];
+        }
+        close(pipeFds[0]);
+
+        if (verifyCrashFiles(vdiskname, durableSizes, 0) != 0 || measureCapacity(vdiskname) != capacity)
+        {
+            printf("round %d: recovery failed\n", round);
+            failures++;
+        }
+    }
+
+    // Two synced transactions, the second is torn and replay keeps the files as the first left them
+    int sizes[BENCH_CRASH_FILES];
+    vsformat(vdiskname, BENCH_DISK_SHIFT);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        vssetflushpolicy(FLUSH_ON_SYNC, 0);
+        vsmount(vdiskname);
+        for (int phase = 0; phase < 2; phase++)
+        {
+            for (int f = 0; f < BENCH_CRASH_FILES; f++)
+            {
+                sprintf(filename, "crash%d", f);
+                int size = (phase == 0) ? 0 : 2000 + f * 2000;
+                if (phase == 0)
+                {
+                    vscreate(filename);
+                }
+                for (int i = 0; i < 2000 + f * 2000; i++)
+                {
+                    buffer[i] = crashPattern(f, size + i);
+                }
+                int fd = vsopen(filename, MODE_APPEND);
+                vsappend(fd, buffer, 2000 + f * 2000);
+                vsclose(fd);
+            }
+            vssync();
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    for (int f = 0; f < BENCH_CRASH_FILES; f++)
+    {
+        sizes[f] = 2000 + f * 2000;
+    }
+    int torn = tearLastTransaction(vdiskname, vsgetblocksize());
+    if (torn != 0 || verifyCrashFiles(vdiskname, sizes, 1) != 0 || measureCapacity(vdiskname) != capacity)
+    {
+        printf("torn commit: recovery failed\n");
+        failures++;
+    }
+
+    for (int f = 0; f < BENCH_CRASH_FILES; f++)
+    {
+        sizes[f] = 2 * (2000 + f * 2000);
+    }
+    if (checkLostDataWrite(vdiskname, sizes) != 0)
+    {
+        printf("lost data write: recovery failed\n");
+        failures++;
+    }
+
+    printf("%d crash rounds, a torn commit and a lost data write: %d failures, capacity %lld KB\n", rounds, failures,
+           capacity >> 10);
+    return failures > 0 ? -1 : 0;
+}
+
+struct stressThreadArgs
+{
+    int index;
+    int size;     // Bytes of the own file of an appender or reopener when it is done
+    int failures;
+};
+
+// Checks n bytes read at offset of a file written with crashPattern
+int checkStressData(unsigned char *buffer, int file, int offset, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (buffer[i] != crashPattern(file, offset + i))
+        {
+            printf("stress: file %d wrong data at %d\n", file, offset + i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Appends the pattern of file to fd, n bytes after size
+int appendStressData(int fd, int file, int size, int n)
+{
+    unsigned char buffer[BENCH_STRESS_APPEND_MAX];
+    for (int i = 0; i < n; i++)
+    {
+        buffer[i] = crashPattern(file, size + i);
+    }
+    return vsappend(fd, buffer, n) == n ? 0 : -1;
+}
+
+// One of four roles by index: an appender of its own file that reads back what it wrote, a reader of the
+// shared hot file through its own descriptor and views, a create and delete churn over the directory, and a
+// reopener that deletes its file while two descriptors are open on it so they are closed under the others
+void *stressThread(void *arg)
+{
+    struct stressThreadArgs *args = (struct stressThreadArgs *)arg;
+    unsigned char buffer[BENCH_STRESS_APPEND_MAX];
+    unsigned int seed = args->index;
+    char filename[30];
+    int role = args->index % 4;
+    int size = 0;
+
+    sprintf(filename, "stress%d", args->index);
+    if (role == 0)
+    {
+        int fd = vsopen(filename, MODE_APPEND);
+        for (int round = 0; round < BENCH_STRESS_ROUNDS && !args->failures; round++)
+        {
+            int n = 1 + rand_r(&seed) % BENCH_STRESS_APPEND_MAX;
+            if (appendStressData(fd, args->index, size, n) != 0)
+            {
+                args->failures++;
+                break;
+            }
+            size += n;
+
+            // Descriptors for reading are separate, reopen one over a random part of the file
+            int readFd = vsopen(filename, MODE_READ);
+            int offset = rand_r(&seed) % size;
+            int length = (size - offset < BENCH_STRESS_APPEND_MAX) ? size - offset : BENCH_STRESS_APPEND_MAX;
+            if (vssize(readFd) != size || vspread(readFd, buffer, length, offset) != length ||
+                checkStressData(buffer, args->index, offset, length) != 0)
+            {
+                args->failures++;
+            }
+            vsclose(readFd);
+        }
+        vsclose(fd);
+    }
+    else if (role == 1)
+    {
+        int fd = vsopen("hot", MODE_READ);
+        for (int round = 0; round < BENCH_STRESS_ROUNDS * 4 && !args->failures; round++)
+        {
+            int offset = rand_r(&seed) % (BENCH_THREAD_FILE_SIZE - BENCH_STRESS_APPEND_MAX);
+            int length = 1 + rand_r(&seed) % BENCH_STRESS_APPEND_MAX;
+            if (round % 8 == 7)
+            {
+                // A view over the same range, its segments point into blocks of the file. Every fourth one covers
+                // the whole file, more blocks than the default buffer cache, while the others keep appending.
+                struct iovec *iov;
+                int cnt;
+                if (round % 32 == 31)
+                {
+                    offset = 0;
+                    length = BENCH_THREAD_FILE_SIZE;
+                }
+                if (vsseek(fd, offset) != offset || vsreadview(fd, length, &iov, &cnt) != length)
+                {
+                    args->failures++;
+                    break;
+                }
+                for (int i = 0; i < cnt; i++)
+                {
+                    if (checkStressData((unsigned char *)iov[i].iov_base, BENCH_STRESS_HOT_FILE, offset, iov[i].iov_len) != 0)
+                    {
+                        args->failures++;
+                    }
+                    offset += iov[i].iov_len;
+                }
+                vsreleaseview(fd);
+            }
+            else if (vspread(fd, buffer, length, offset) != length ||
+                     checkStressData(buffer, BENCH_STRESS_HOT_FILE, offset, length) != 0)
+            {
+                args->failures++;
+                break;
+            }
+        }
+        vsclose(fd);
+    }
+    else if (role == 2)
+    {
+        struct vsDirent entries[4];
+        for (int round = 0; round < BENCH_STRESS_ROUNDS && !args->failures; round++)
+        {
+            sprintf(filename, "churn%d_%d", args->index, round);
+            if (vscreate(filename) != 0)
+            {
+                args->failures++;
+                break;
+            }
+            int fd = vsopen(filename, MODE_APPEND);
+            if (appendStressData(fd, args->index, 0, 1 + rand_r(&seed) % 200) != 0 || vsclose(fd) != 0 || vsdelete(filename) != 0)
+            {
+                args->failures++;
+            }
+            if (vsreaddir("/", entries, 4) < 0)
+            {
+                args->failures++;
+            }
+        }
+    }
+    else
+    {
+        for (int round = 0; round < BENCH_STRESS_ROUNDS && !args->failures; round++)
+        {
+            int n = 1 + rand_r(&seed) % BENCH_STRESS_APPEND_MAX;
+            int appendFd = vsopen(filename, MODE_APPEND);
+            int readFd = vsopen(filename, MODE_READ);
+            if (appendStressData(appendFd, args->index, 0, n) != 0 || vspread(readFd, buffer, n, 0) != n ||
+                checkStressData(buffer, args->index, 0, n) != 0)
+            {
+                args->failures++;
+            }
+            size = n;
+
+            // Both descriptors are closed by the delete and are not used again
+            if (round + 1 < BENCH_STRESS_ROUNDS)
+            {
+                if (vsdelete(filename) != 0 || vscreate(filename) != 0)
+                {
+                    args->failures++;
+                }
+                size = 0;
+            }
+            else
+            {
+                vsclose(appendFd);
+                vsclose(readFd);
+            }
+        }
+    }
+
+    args->size = size;
+    return NULL;
+}
+
+// Runs threadCount threads of the four stressThread roles on one disk under the periodic flush, then mounts the
+// disk again and checks every file the threads left and that deleting them gives back all blocks
+int benchStress(char *vdiskname, int threadCount)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    struct stressThreadArgs args[BENCH_MAX_THREADS];
+    static unsigned char buffer[BENCH_CRASH_FILE_MAX];
+    struct vsDirent entries[BENCH_MAX_THREADS + 2];
+    struct timespec start;
+    char filename[30];
+    int failures = 0;
+
+    if (vsformat(vdiskname, BENCH_DISK_SHIFT) != 0)
+    {
+        return -1;
+    }
+    long long capacity = measureCapacity(vdiskname);
+
+    vssetflushpolicy(FLUSH_PERIODIC, 1);
+    if (vsmount(vdiskname) != 0 || vscreate("hot") != 0)
+    {
+        return -1;
+    }
+    int fd = vsopen("hot", MODE_APPEND);
+    for (int size = 0; size < BENCH_THREAD_FILE_SIZE; size += BENCH_STRESS_APPEND_MAX / 2)
+    {
+        appendStressData(fd, BENCH_STRESS_HOT_FILE, size, BENCH_STRESS_APPEND_MAX / 2);
+    }
+    vsclose(fd);
+    for (int i = 0; i < threadCount; i++)
+    {
+        args[i].index = i;
+        args[i].size = 0;
+        args[i].failures = 0;
+        sprintf(filename, "stress%d", i);
+        if (i % 4 == 0 || i % 4 == 3)
+        {
+            vscreate(filename);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_create(&threads[i], NULL, stressThread, &args[i]);
+    }
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+        failures += args[i].failures;
+    }
+    double seconds = elapsedSeconds(&start);
+    vsumount();
+    vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+
+    // Only the hot file and the own files of appenders and reopeners are left
+    if (vsmount(vdiskname) != 0)
+    {
+        return -1;
+    }
+    int expected = 1;
+    for (int i = 0; i < threadCount; i++)
+    {
+        if (i % 4 != 0 && i % 4 != 3)
+        {
+            continue;
+        }
+        expected++;
+        sprintf(filename, "stress%d", i);
+        fd = vsopen(filename, MODE_READ);
+        if (fd == -1 || vssize(fd) != args[i].size || vsread(fd, buffer, args[i].size) != args[i].size ||
+            checkStressData(buffer, i, 0, args[i].size) != 0)
+        {
+            printf("stress: %s does not hold its %d bytes\n", filename, args[i].size);
+            failures++;
+        }
+        vsclose(fd);
+        vsdelete(filename);
+    }
+    fd = vsopen("hot", MODE_READ);
+    if (fd == -1 || vsread(fd, buffer, BENCH_THREAD_FILE_SIZE) != BENCH_THREAD_FILE_SIZE ||
+        checkStressData(buffer, BENCH_STRESS_HOT_FILE, 0, BENCH_THREAD_FILE_SIZE) != 0)
+    {
+        failures++;
+    }
+    vsclose(fd);
+    vsdelete("hot");
+    int count = vsreaddir("/", entries, BENCH_MAX_THREADS + 2);
+    if (count != 0)
+    {
+        printf("stress: %d files left of %d\n", count, expected);
+        failures++;
+    }
+    vsumount();
+    if (measureCapacity(vdiskname) != capacity)
+    {
+        printf("stress: blocks leaked\n");
+        failures++;
+    }
+
+    printf("%2d stress threads: %8.3f s, %d failures\n", threadCount, seconds, failures);
+    return failures > 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    char vdiskname[200];
+    char *benchmark;
+    if (argc < 3)
+    {
+        printf("usage: bench <vdiskname> <read [MB] | view [MB] | kernel | frag | transfer | backend | threads | metadata | open | dir | path | size [max shift] | first | blocksize [MB] | random | async [MB] | disks [threads] | tiny [files] | delayed [append size] | descriptors [max count] | crash [rounds] | stress [threads]>\n");
+        exit(1);
+    }
+    strcpy(vdiskname, argv[1]);
+    benchmark = argv[2];
+
+    if (strcmp(benchmark, "read") == 0)
+    {
+        int fileSize = (argc > 3 ? atoi(argv[3]) : 4) << 20;
+        for (int mountMode = MOUNT_FD; mountMode <= MOUNT_MMAP; mountMode++)
+        {
+            if (prepareDisk(vdiskname, mountMode) != 0 || createBenchFile("bench.bin", fileSize) != 0)
+            {
+                exit(1);
+            }
+
+            printf("%s backend\n", mountMode == MOUNT_MMAP ? "mmap" : "fd");
+            benchSequentialRead("bench.bin", 1);
+            benchSequentialRead("bench.bin", 64);
+            benchSequentialRead("bench.bin", 4096);
+
+            struct vsCacheStats stats;
+            vsgetcachestats(&stats);
+            printf("buffer cache: %ld hits %ld misses %ld evictions %ld writebacks\n",
+                   stats.hits, stats.misses, stats.evictions, stats.writebacks);
+            vsumount();
+        }
+    }
+    else if (strcmp(benchmark, "view") == 0)
+    {
+        int fileSize = (argc > 3 ? atoi(argv[3]) : 4) << 20;
+        for (int mountMode = MOUNT_FD; mountMode <= MOUNT_MMAP; mountMode++)
+        {
+            if (prepareDisk(vdiskname, mountMode) != 0 || createBenchFile("bench.bin", fileSize) != 0)
+            {
+                exit(1);
+            }
+
+            printf("%s backend\n", mountMode == MOUNT_MMAP ? "mmap" : "fd");
+            benchViewChecksum("bench.bin", 4096);
+            benchViewChecksum("bench.bin", 65536);
+            vsumount();
+        }
+    }
+    else if (strcmp(benchmark, "kernel") == 0)
+    {
+        int chunkSizes[3] = {64, 512, 2048};
+        int startOffsets[3] = {0, 1, 7};
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                benchCopyKernel(chunkSizes[i], startOffsets[j]);
+            }
+        }
+        vsumount();
+    }
+    else if (strcmp(benchmark, "frag") == 0)
+    {
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        benchInterleavedAppend(3000, 200);
+        vsumount();
+    }
+    else if (strcmp(benchmark, "transfer") == 0)
+    {
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        benchLargeTransfers(4);
+        vsumount();
+    }
+    else if (strcmp(benchmark, "threads") == 0)
+    {
+        char filename[30];
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        for (int i = 0; i < BENCH_MAX_THREADS; i++)
+        {
+            sprintf(filename, "thread%d.bin", i);
+            if (createBenchFile(filename, BENCH_THREAD_FILE_SIZE) != 0)
+            {
+                exit(1);
+            }
+        }
+        vssync();
+        for (int threadCount = 1; threadCount <= BENCH_MAX_THREADS; threadCount *= 2)
+        {
+            benchThreadScaling(threadCount, 0);
+            benchThreadScaling(threadCount, 1);
+            benchThreadScaling(threadCount, 2);
+        }
+        vsumount();
+    }
+    else if (strcmp(benchmark, "metadata") == 0)
+    {
+        for (int policy = FLUSH_IMMEDIATE; policy <= FLUSH_ON_SYNC; policy++)
+        {
+            benchMetadataFlush(vdiskname, policy);
+        }
+        vssetflushpolicy(FLUSH_ON_CLOSE, 0);
+    }
+    else if (strcmp(benchmark, "open") == 0)
+    {
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        benchOpenChurn(120, 200);
+        vsumount();
+    }
+    else if (strcmp(benchmark, "dir") == 0)
+    {
+        for (int fileCount = 128; fileCount <= 4096; fileCount *= 4)
+        {
+            benchDirectoryScaling(vdiskname, fileCount);
+        }
+    }
+    else if (strcmp(benchmark, "path") == 0)
+    {
+        for (int depth = 1; depth <= 16; depth *= 2)
+        {
+            benchPathLookup(vdiskname, depth, 200000);
+        }
+    }
+    else if (strcmp(benchmark, "size") == 0)
+    {
+        int maxShift = argc > 3 ? atoi(argv[3]) : 30;
+        for (int shift = BENCH_DISK_SHIFT; shift <= maxShift; shift += 2)
+        {
+            benchDiskSize(vdiskname, shift);
+        }
+    }
+    else if (strcmp(benchmark, "first") == 0)
+    {
+        for (int fileCount = 4; fileCount <= 64; fileCount *= 4)
+        {
+            benchFirstRead(vdiskname, 30, fileCount, (512 / fileCount) << 20);
+        }
+    }
+    else if (strcmp(benchmark, "random") == 0)
+    {
+        for (int fileSize = 16; fileSize <= 256; fileSize *= 4)
+        {
+            benchRandomRead(vdiskname, fileSize << 20, 20000);
+        }
+    }
+    else if (strcmp(benchmark, "blocksize") == 0)
+    {
+        int fileSize = (argc > 3 ? atoi(argv[3]) : 64) << 20;
+        for (int blockSize = 512; blockSize <= 65536; blockSize *= 2)
+        {
+            benchBlockSize(vdiskname, blockSize, fileSize);
+        }
+    }
+    else if (strcmp(benchmark, "async") == 0)
+    {
+        int fileSize = (argc > 3 ? atoi(argv[3]) : 64) << 20;
+        benchAsyncRead(vdiskname, ASYNC_IO_URING, fileSize, 20000);
+        benchAsyncRead(vdiskname, ASYNC_THREAD_POOL, fileSize, 20000);
+    }
+    else if (strcmp(benchmark, "disks") == 0)
+    {
+        int maxThreads = argc > 3 ? atoi(argv[3]) : 8;
+        maxThreads = (maxThreads < BENCH_MAX_THREADS) ? maxThreads : BENCH_MAX_THREADS;
+        for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            benchDiskScaling(vdiskname, threadCount, 0);
+            benchDiskScaling(vdiskname, threadCount, 1);
+        }
+    }
+    else if (strcmp(benchmark, "tiny") == 0)
+    {
+        benchTinyFiles(vdiskname, argc > 3 ? atoi(argv[3]) : 4000);
+    }
+    else if (strcmp(benchmark, "delayed") == 0)
+    {
+        int appendSize = argc > 3 ? atoi(argv[3]) : 512;
+        benchDelayedAppend(vdiskname, FLUSH_IMMEDIATE, appendSize);
+        benchDelayedAppend(vdiskname, FLUSH_ON_CLOSE, appendSize);
+    }
+    else if (strcmp(benchmark, "descriptors") == 0)
+    {
+        int maxCount = argc > 3 ? atoi(argv[3]) : 65536;
+        if (prepareDisk(vdiskname, MOUNT_FD) != 0)
+        {
+            exit(1);
+        }
+        for (int descriptorCount = 16; descriptorCount <= maxCount; descriptorCount *= 16)
+        {
+            benchDescriptorTable(descriptorCount);
+        }
+        vsumount();
+    }
+    else if (strcmp(benchmark, "crash") == 0)
+    {
+        if (benchCrashRecovery(vdiskname, argc > 3 ? atoi(argv[3]) : 20) != 0)
+        {
+            exit(1);
+        }
+    }
+    else if (strcmp(benchmark, "stress") == 0)
+    {
+        int threadCount = argc > 3 ? atoi(argv[3]) : 8;
+        threadCount = (threadCount < BENCH_MAX_THREADS) ? threadCount : BENCH_MAX_THREADS;
+        if (benchStress(vdiskname, threadCount) != 0)
+        {
+            exit(1);
+        }
+    }
+    else if (strcmp(benchmark, "backend") == 0)
+    {
+        benchAppWorkload(vdiskname, MOUNT_FD);
+        benchAppWorkload(vdiskname, MOUNT_MMAP);
+    }
+    else
+    {
+        printf("unknown benchmark %s\n", benchmark);
+        exit(1);
+    }
+
+    return 0;
+}
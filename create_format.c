@@ -2,25 +2,50 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include "vsfs.h"
 int main(int argc, char **argv)
 {
     int ret;
     char vdiskname[200];
     int m;
-    if (argc != 3)
+    int formatMode = FORMAT_SPARSE;
+    int blockSize = BLOCKSIZE;
+    struct timespec start, end;
+    if (argc < 3 || argc > 5)
     {
-        printf("usage: create_format <vdiskname> <m>\n");
+        printf("usage: create_format <vdiskname> <m> [sparse | prealloc] [block size]\n");
         exit(1);
     }
     strcpy(vdiskname, argv[1]);
     m = atoi(argv[2]);
+    if (argc >= 4 && strcmp(argv[3], "prealloc") == 0)
+    {
+        formatMode = FORMAT_PREALLOCATE;
+    }
+    else if (argc >= 4 && strcmp(argv[3], "sparse") != 0)
+    {
+        printf("unknown format mode %s\n", argv[3]);
+        exit(1);
+    }
+    if (argc == 5)
+    {
+        blockSize = atoi(argv[4]);
+        if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE || (blockSize & (blockSize - 1)) != 0)
+        {
+            printf("block size must be a power of two between %d and %d bytes\n", MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+            exit(1);
+        }
+    }
     printf("started\n");
-    ret = vsformat(vdiskname, m);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = vsformatmode(vdiskname, m, formatMode, blockSize);
+    clock_gettime(CLOCK_MONOTONIC, &end);
     if (ret != 0)
     {
         printf("there was an error in creating the disk\n");
         exit(1);
     }
-    printf("disk created and formatted. %s %d\n", vdiskname, m);
-}
\ No newline at end of file
+    printf("disk created and formatted. %s %d, %d byte blocks\n", vdiskname, m, blockSize);
+    printf("elapsed time: %.3f ms\n", (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+}
@@ -1,33 +1,77 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include "vsfs.h"
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+#endif
+#include "vsfs_internal.h"
 
 #define SUPERBLOCK_START 0 // Block 0
 #define SUPERBLOCK_COUNT 1
-#define FAT_BLOCK_START 1 // Blocks 1, ..., 32
-#define FAT_BLOCK_COUNT 32
-#define ROOT_DIR_START 33 // Blocks 33, ..., 40
-#define ROOT_DIR_COUNT 8
-#define METADATA_BLOCK_SIZE (SUPERBLOCK_COUNT + FAT_BLOCK_COUNT + ROOT_DIR_COUNT)
+#define FAT_BLOCK_START 1 // Blocks 1, ..., fatBlockCount, sized at format time
+#define ROOT_DIR_COUNT 8  // First blocks of the directory chain, right after the FAT
+#define JOURNAL_FIXED_SIZE 131072 // Journal bytes besides the room for a transaction that changes the whole FAT
+#define FREE_SUMMARY_OFFSET 64    // Bytes into the superblock
+#define FREE_SUMMARY_REGIONS 448  // Most free block counts of FAT regions kept in the superblock, fewer in small blocks
+#define FREE_SUMMARY_UNKNOWN -1   // Region count that is not trusted until the region is loaded
+#define VSFS_MAGIC 0x53465356 // "VSFS"
+#define VSFS_VERSION 7
+#define JOURNAL_MAGIC 0x4c4e524a // "JRNL"
+#define JOURNAL_HEADER_SIZE 32   // Bytes at the start of the first block of a transaction
+#define JOURNAL_RECORD_FAT 1     // First entry, entry count, values
+#define JOURNAL_RECORD_DIR 2     // Entry index, DIR_ENTRY_SIZE bytes
+#define JOURNAL_RECORD_SUPER 3   // Free block count, file count
 #define FAT_ENTRY_SIZE 4                                        // Bytes
-#define FAT_ENTRY_PER_BLOCK (BLOCKSIZE / FAT_ENTRY_SIZE)        // 512 entries
-#define FAT_ENTRY_COUNT (FAT_ENTRY_PER_BLOCK * FAT_BLOCK_COUNT) // Bytes
-#define MAX_DISK_SIZE_SHIFT 23                                  // Shift amount
+#define FAT_RECORD_MAX ((3 + disk->fatEntriesPerBlock) * FAT_ENTRY_SIZE) // Bytes of the journal record of a whole FAT block
+#define MAX_DISK_SIZE_SHIFT 46                                  // Shift amount, 64TB in 64KB blocks
 #define MIN_DISK_SIZE_SHIFT 18                                  // Shift amount
+#define MAX_DISK_BLOCK_SHIFT 30                                 // Blocks of a disk, block numbers and counts are ints
 #define DIR_ENTRY_SIZE 128                                      // Bytes
-#define DIR_ENTRY_PER_BLOCK (BLOCKSIZE / DIR_ENTRY_SIZE)        // 4KB (BLOCKSIZE)/128 Bytes (DIR_ENTRY_SIZE)
-#define DIR_ENTRY_COUNT (DIR_ENTRY_PER_BLOCK * ROOT_DIR_COUNT)  // 4(ROOT_DIR_COUNT) * 32 (DIR_ENTRY_PER_BLOCK)
+#define INLINE_DATA_OFFSET 50                                   // Bytes into a directory entry, after its fields
+#define INLINE_DATA_MAX (DIR_ENTRY_SIZE - INLINE_DATA_OFFSET)   // Bytes of a file kept in its directory entry
+#define DIR_ENTRY_MAX (1 << 20)                                 // Entries of the directory chain
+#define DIR_BLOCK_MAX (DIR_ENTRY_MAX / (MIN_BLOCK_SIZE / DIR_ENTRY_SIZE)) // Blocks of the directory chain in the smallest blocks
+#define DIR_CHUNK_ENTRIES 1024                                  // Directory entries allocated together in memory
+#define DIR_CHUNK_COUNT (DIR_ENTRY_MAX / DIR_CHUNK_ENTRIES)
+#define DIR_DIRTY_BLOCK_LIMIT 16                                // Dirty directory blocks that force a journal commit
+#define SKIP_INDEX_INTERVAL 64                                  // Blocks of a file chain between samples of its skip index
 #define MAX_FILENAME_LENGTH 30
-#define MAX_NOF_OPEN_FILES 16
+#define OPEN_FILE_CHUNK_ENTRIES 256                             // Descriptors allocated together in memory
+#define OPEN_FILE_CHUNK_COUNT 4096
+#define MAX_NOF_OPEN_FILES (OPEN_FILE_CHUNK_ENTRIES * OPEN_FILE_CHUNK_COUNT)
 #define NOT_USED_FLAG 0
 #define USED_FLAG 1
 #define EOF_FLAG -1
+#define FILENAME_HASH_MIN_SIZE 256   // Buckets, kept at least twice the number of files
+#define ROOT_DIRECTORY_INDEX -1       // Parent of the entries in the root directory
+#define PATH_SEPARATOR '/'
+#define BUFFER_CACHE_DEFAULT_SIZE 256 // Blocks (512KB of 2KB blocks)
+#define BITMAP_WORD_BITS 64
+#define ALLOCATION_WINDOW_DEFAULT 16 // Blocks
+#define ALLOCATION_SEARCH_RUNS 64     // Free runs looked at for a new extent before the longest seen is taken
+#define DELAYED_APPEND_BLOCKS 32      // Blocks of appended data held in memory until they are allocated together
+#define VECTORED_IO_MIN_BLOCKS 2      // Shorter runs of full blocks go through the buffer cache
+#define VIEW_PIN_SHARE 2              // Read views pin at most 1/VIEW_PIN_SHARE of the buffer cache slots, larger ones are copied
+#define WRITEBACK_VECTOR_MAX 64       // Blocks per pwritev during write back
+#define FORMAT_WRITE_SIZE 524288      // Bytes of metadata blocks per write while formatting
+#define FLUSH_INTERVAL_DEFAULT 1000   // Milliseconds between periodic flushes
+#define ASYNC_RING_ENTRIES 256        // Block runs in flight on the io_uring
+#define ASYNC_THREAD_COUNT 8          // Threads of the fallback pool
 
 struct dirEntry
 {
@@ -35,11 +79,38 @@ struct dirEntry
     int size;                           // 4 Bytes
     int startBlock;                     // 4 Bytes
     int allocated;                      // 4 Bytes
+    int parent;                         // 4 Bytes, entry of the parent directory or ROOT_DIRECTORY_INDEX
+    int type;                           // 4 Bytes, TYPE_FILE or TYPE_DIRECTORY
+    char inlineData[INLINE_DATA_MAX];   // 78 Bytes, data of a file without blocks (startBlock -1)
+    int lastBlock;                      // Memory only, tail of the FAT chain or -1 until the first append
+    int blockCount;                     // Memory only, length of the FAT chain
+    int viewCount;                      // Memory only, outstanding vsreadview spans
+    int openDescriptor;                 // Memory only, first descriptor open on the file or -1, the others follow nextOpen
+    int hashNext;                       // Memory only, next entry in the same filename bucket or -1
+    int firstChild;                     // Memory only, first entry of a directory or -1
+    int nextSibling;                    // Memory only, entries of the same directory
+    int prevSibling;
+    int *skipIndex;                     // Memory only, block at every SKIP_INDEX_INTERVAL blocks of the chain, NULL until walked
+    int skipIndexCount;                 // Memory only, samples cover the chain up to the last one
+    int skipIndexCapacity;
+    int asyncCount;                     // Memory only, asynchronous requests not completed
+    int asyncWriteCount;                // Memory only, of them appends, readers wait for their blocks
+    char *delayedData;                  // Memory only, appended bytes not on blocks yet, counted in size only when written
+    int delayedSize;
+    int delayedCapacity;
+    int reservedBlocks;                 // Memory only, free blocks held for the delayed bytes
+    pthread_rwlock_t lock;              // Memory only, shared by readers, exclusive for appends and deletes
+    pthread_mutex_t indexLock;          // Memory only, guards the skip index while readers share the file
 };
 
-struct fatEntry
+// One FAT block, loaded from its home block the first time any of its entries is used
+struct fatPage
 {
-    int nextBlockIndex; // 4 bytes
+    int *entries;                           // Next block of each block, fatEntriesPerBlock entries
+    int *journaled;                         // As last committed to the journal
+    unsigned long long *freeBits;           // A set bit is a free block, bitmapWordCount words
+    unsigned long long *pendingFreeBits;    // Freed since the last journal commit
+    unsigned long long *committingFreeBits; // Freed by the transaction being committed
 };
 
 struct fileStruct
@@ -49,861 +120,5244 @@ struct fileStruct
     int dirBlockOffset;     // 4 Bytes
     int cachedRootDirIndex; // 4 Bytes
     int positionPtr;        // 4 Bytes
+    int cursorLogicalBlock; // 4 Bytes, logical block of the last accessed block
+    int cursorBlock;        // 4 Bytes, physical block of the last accessed block
+    struct iovec *view;             // Spans handed out by vsreadview, NULL if none
+    struct cacheBlock **viewBlocks; // Cache slots pinned by the view
+    int viewBlockCount;
+    char *viewCopy;                 // Bytes of a view that would pin too many slots, NULL if it pins
+    int nextOpen;                   // Other descriptors open on the same file, -1 at the end
+    int prevOpen;
+    int generation;                 // Counts the opens of the descriptor, a reused descriptor is a different open
+    pthread_mutex_t lock;           // Serializes users of the descriptor, its position, cursor and view
 };
 
-// Globals =======================================
-int vs_fd; // File descriptor of the Linux file.
-// The Linux file is our disk.
-// This descriptor is not visible to an application.
-// ========================================================
+struct cacheBlock
+{
+    int block;                   // Physical block number, -1 if the slot is empty
+    int dirty;                   // Data differs from the virtual disk
+    int pinCount;                // Pinned slots are never evicted
+    int loading;                 // Data is being read from the virtual disk
+    char *data;                  // blockSize bytes
+    struct cacheBlock *hashNext; // Next slot in the same hash bucket
+    struct cacheBlock *lruPrev;  // More recently used slot
+    struct cacheBlock *lruNext;  // Less recently used slot
+};
+
+// One vsreadasync or vsappendasync call, completed when its last block run is
+struct asyncRequest
+{
+    void *userData;
+    int result;            // Bytes of the request, reported unless a run failed
+    int failed;
+    int isWrite;
+    int pendingOperations; // Runs in flight, plus one while the request is submitted
+    int submittedOperations;
+    struct dirEntry *file;
+    struct asyncRequest *next; // Completed requests not polled yet
+};
+
+// Blocks read or written by the backend for a request
+struct asyncOperation
+{
+    struct asyncRequest *request;
+    char *buffer;   // Data of the run, or a block to copy a span out of
+    int block;
+    int count;
+    char *copyTo;   // Destination of the span, NULL when the run is read in place
+    int copyOffset;
+    int copyLength;
+    struct asyncOperation *next; // Runs waiting for a pool thread
+};
+
+#ifdef HAVE_IO_URING
+// Submission and completion rings shared with the kernel
+struct asyncRing
+{
+    int fd;
+    unsigned int entries;
+    unsigned int inFlight;
+    unsigned int *sqTail;
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+};
+#endif
+
+// State of one virtual disk, every call works on the disk of the calling thread
+struct vsfs
+{
+    int vs_fd; // File descriptor of the Linux file.
+    // The Linux file is our disk.
+    // This descriptor is not visible to an application.
+
+    // Mapping of the whole Linux file when mounted with MOUNT_MMAP, NULL otherwise
+    char *mappedDisk;
+    size_t mappedDiskSize;
+    size_t mappedDirtyStart; // Byte range written since the last msync
+    size_t mappedDirtyEnd;
+
+    // Initialized by the superblock
+    int dataBlockCount;
+    int totalBlockCount;
+    int freeBlockCount;
+    int fileCount;
+    int diskMounted;
+    // Block size chosen at format time, BLOCKSIZE until a disk is formatted or mounted
+    int blockSize;
+    int blockShift;         // log2 of blockSize
+    int fatEntriesPerBlock; // FAT entries, and blocks mapped, per FAT block
+    int fatEntryShift;
+    int dirEntriesPerBlock;
+    int bitmapWordCount;    // Free bitmap words per FAT page
+    int freeSummaryRegions; // Regions whose free counts fit in the superblock
+    int directoryBlockLimit; // Blocks of the directory chain holding DIR_ENTRY_MAX entries
+    // Layout derived from the FAT size in the superblock
+    int fatBlockCount;
+    int rootDirStart;      // First block of the directory chain
+    int journalStart;
+    int journalBlockCount;
+    int metadataBlockCount; // Blocks before the first data block
+    int summaryRegionPages; // FAT pages per region of the free summary
+
+    int openFileCount;
+    // Descriptors in chunks that never move, so a descriptor can be used without the namespace lock
+    struct fileStruct *openFileTable[OPEN_FILE_CHUNK_COUNT];
+    int openFileTableSize; // Descriptors in allocated chunks
+    int *freeDescriptors;  // Stack of unused descriptors
+    int freeDescriptorCount;
+    // FAT pages by FAT block, NULL until the page is first used, pages stay loaded until unmount
+    struct fatPage **fatPages;
+    // Directory entries in chunks that never move, so entries can be used without the directory lock
+    struct dirEntry *cachedRootDirectory[DIR_CHUNK_COUNT];
+    int directoryEntryCount; // dirEntriesPerBlock entries per block of the directory chain
+    int directoryBlockCount;
+    int directoryLastBlock;  // Tail of the directory chain, new directory blocks are linked after it
+    int *freeDirectorySlots; // Stack of unused entries
+    int freeDirectorySlotCount;
+    int rootFirstChild; // First entry of the root directory or -1
+    int *filenameHash;  // First directory entry of each bucket or -1, keyed by parent and name
+    int filenameHashSize;
+    int filenameHashEntries;
+
+    // Metadata blocks changed in memory since they were last written
+    char *fatBlockDirty; // fatBlockCount entries
+    char rootDirBlockDirty[DIR_BLOCK_MAX];
+    int rootDirBlockDirtyCount;
+    // Metadata as last committed to the journal, the home blocks are checkpointed from here
+    char *journaledRootDirectory;
+    int journaledDirectoryBlocks[DIR_BLOCK_MAX]; // Home block of each directory block
+    int journaledDirectoryBlockCount;
+    int journaledDirectoryCapacity; // Blocks held by journaledRootDirectory, replay may run ahead of the chain
+    int journaledFreeBlockCount;
+    int journaledFileCount;
+    char *fatBlockCheckpoint;
+    char rootDirBlockCheckpoint[DIR_BLOCK_MAX];
+    char emptyDirectoryEntry[DIR_ENTRY_SIZE]; // Entries of directory blocks not committed yet
+    int journalHead;     // Next journal block to write
+    int journalSequence; // Sequence number of the next transaction
+    char *journalBuffer; // Grown to the largest transaction written or replayed
+    size_t journalBufferSize;
+
+    // Asynchronous requests, the backend starts with the first one after a mount
+    int asyncBackendSetting;
+    int asyncBackend; // Running backend, -1 if none
+    int asyncStopping;
+    int asyncRequestsInFlight;
+    int asyncOperationsInFlight;
+    int asyncWritesInFlight; // Runs being written, flushes wait for them before committing
+    struct asyncRequest *asyncReadyHead; // Completed requests in completion order
+    struct asyncRequest *asyncReadyTail;
+    int asyncReadyCount;
+    struct asyncOperation *asyncQueueHead; // Runs waiting for a pool thread
+    struct asyncOperation *asyncQueueTail;
+    pthread_t asyncThreads[ASYNC_THREAD_COUNT];
+    int asyncThreadCount;
+#ifdef HAVE_IO_URING
+    struct asyncRing asyncRing;
+#endif
+
+    int flushPolicy;
+    int flushInterval;
+    pthread_t flushThread;
+    int flushThreadRunning;
+
+    int pendingFreeCount; // Freed blocks not reusable yet, including those of the transaction being committed
+    int reservedBlockCount; // Free blocks held for delayed appends, only their files allocate them
+    // Free blocks of each region as persisted in the superblock and updated since, a hint for regions not loaded yet
+    int freeSummary[FREE_SUMMARY_REGIONS];
+    int regionLoadedPages[FREE_SUMMARY_REGIONS];
+    int nextFitBlock; // Block where the next allocation search starts
+    // Minimum free run a file should start a new extent in
+    int allocationWindow;
+
+    // Buffer cache of data blocks, metadata blocks are cached separately above
+    int bufferCacheSize;
+    int bufferCacheHashSize;
+    struct cacheBlock *bufferCache;
+    struct cacheBlock **bufferCacheHash;
+    struct cacheBlock *lruHead; // Most recently used
+    struct cacheBlock *lruTail; // Least recently used, next victim
+    int viewPinnedCount;        // Slots pinned by read views, under the cache lock
+    struct cacheBlock **writebackBlocks; // Dirty slots sorted for write back, under the cache lock
+    struct vsCacheStats cacheStats;
+    struct vsIoStats ioStats;
+
+    // Locks, when nested always taken in this order:
+    // namespaceLock, file lock (dirEntry), descriptor lock (fileStruct), metadataFlushLock, transactionLock, directoryLock,
+    // allocatorLock, fatPageLock, cacheLock, asyncLock, skip index lock (dirEntry)
+    pthread_mutex_t namespaceLock;     // Directory slots, open file table, file count
+    pthread_mutex_t directoryLock;     // Persistent directory entry fields and their blocks
+    pthread_mutex_t allocatorLock;     // FAT entries, free space bits, free block count
+    pthread_mutex_t fatPageLock;       // Loading of FAT pages
+    pthread_mutex_t cacheLock;         // Buffer cache slots, dirty range of the mapping
+    pthread_cond_t cacheSlotReady;     // A slot finished loading
+    pthread_mutex_t metadataFlushLock; // One metadata flush at a time, journal state
+    pthread_rwlock_t transactionLock;  // Shared by metadata updates, exclusive while collecting them
+    pthread_mutex_t flushThreadLock;   // Periodic flush thread state
+    pthread_cond_t flushThreadWake;    // Stops the periodic flush thread
+    pthread_mutex_t asyncLock;         // Asynchronous requests, their runs and the backend
+    pthread_cond_t asyncWork;          // A run is queued for the pool
+    pthread_cond_t asyncDone;          // A run or a request completed
+};
+
+// Disk of the vs* calls, the vsfs* calls select theirs while they run
+struct vsfs defaultDisk = {
+    .blockSize = BLOCKSIZE,
+    .asyncBackendSetting = ASYNC_IO_URING,
+    .asyncBackend = -1,
+    .flushPolicy = FLUSH_ON_CLOSE,
+    .flushInterval = FLUSH_INTERVAL_DEFAULT,
+    .allocationWindow = ALLOCATION_WINDOW_DEFAULT,
+    .bufferCacheSize = BUFFER_CACHE_DEFAULT_SIZE,
+    .namespaceLock = PTHREAD_MUTEX_INITIALIZER,
+    .directoryLock = PTHREAD_MUTEX_INITIALIZER,
+    .allocatorLock = PTHREAD_MUTEX_INITIALIZER,
+    .fatPageLock = PTHREAD_MUTEX_INITIALIZER,
+    .cacheLock = PTHREAD_MUTEX_INITIALIZER,
+    .cacheSlotReady = PTHREAD_COND_INITIALIZER,
+    .metadataFlushLock = PTHREAD_MUTEX_INITIALIZER,
+    .transactionLock = PTHREAD_RWLOCK_INITIALIZER,
+    .flushThreadLock = PTHREAD_MUTEX_INITIALIZER,
+    .flushThreadWake = PTHREAD_COND_INITIALIZER,
+    .asyncLock = PTHREAD_MUTEX_INITIALIZER,
+    .asyncWork = PTHREAD_COND_INITIALIZER,
+    .asyncDone = PTHREAD_COND_INITIALIZER,
+};
+__thread struct vsfs *disk = &defaultDisk;
 
-// Initialized by the superblock
-int dataBlockCount;
-int totalBlockCount;
-int freeBlockCount;
-int fileCount;
+int mapped_io(void *buffer, int k, size_t length, int isWrite)
+{
+    size_t offset = (size_t)k * disk->blockSize;
+    if (offset + length > disk->mappedDiskSize)
+    {
+        printf(isWrite ? "write error\n" : "read error\n");
+        return -1;
+    }
 
-int openFileCount = 0;
-struct fileStruct openFileTable[MAX_NOF_OPEN_FILES];
-struct fatEntry cachedFatTable[FAT_ENTRY_COUNT];
-struct dirEntry cachedRootDirectory[DIR_ENTRY_COUNT];
+    if (isWrite)
+    {
+        memcpy(disk->mappedDisk + offset, buffer, length);
+        markMappedRangeDirty(offset, length);
+        __atomic_add_fetch(&disk->ioStats.bytesWritten, length, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        memcpy(buffer, disk->mappedDisk + offset, length);
+        __atomic_add_fetch(&disk->ioStats.bytesRead, length, __ATOMIC_RELAXED);
+    }
+    return (0);
+}
 
 int read_block(void *block, int k)
 {
     int n;
-    int offset;
-    offset = k * BLOCKSIZE;
-    lseek(vs_fd, (off_t)offset, SEEK_SET);
-    n = read(vs_fd, block, BLOCKSIZE);
-    if (n != BLOCKSIZE)
+    off_t offset;
+    if (disk->mappedDisk != NULL)
+    {
+        return mapped_io(block, k, disk->blockSize, 0);
+    }
+
+    offset = (off_t)k * disk->blockSize;
+    n = pread(disk->vs_fd, block, disk->blockSize, offset);
+    __atomic_add_fetch(&disk->ioStats.readCalls, 1, __ATOMIC_RELAXED);
+    if (n != disk->blockSize)
     {
         printf("read error\n");
         return -1;
     }
+    __atomic_add_fetch(&disk->ioStats.bytesRead, n, __ATOMIC_RELAXED);
     return (0);
 }
 
 int write_block(void *block, int k)
 {
     int n;
-    int offset;
-    offset = k * BLOCKSIZE;
-    lseek(vs_fd, (off_t)offset, SEEK_SET);
-    n = write(vs_fd, block, BLOCKSIZE);
-    if (n != BLOCKSIZE)
+    off_t offset;
+    if (disk->mappedDisk != NULL)
+    {
+        return mapped_io(block, k, disk->blockSize, 1);
+    }
+
+    offset = (off_t)k * disk->blockSize;
+    n = pwrite(disk->vs_fd, block, disk->blockSize, offset);
+    __atomic_add_fetch(&disk->ioStats.writeCalls, 1, __ATOMIC_RELAXED);
+    if (n != disk->blockSize)
     {
         printf("write error\n");
         return (-1);
     }
+    __atomic_add_fetch(&disk->ioStats.bytesWritten, n, __ATOMIC_RELAXED);
     return 0;
 }
 
+int read_block_run(void *buffer, int k, int count)
+{
+    ssize_t n;
+    size_t length = (size_t)count * disk->blockSize;
+    if (disk->mappedDisk != NULL)
+    {
+        return mapped_io(buffer, k, length, 0);
+    }
+
+    n = pread(disk->vs_fd, buffer, length, (off_t)k * disk->blockSize);
+    __atomic_add_fetch(&disk->ioStats.readCalls, 1, __ATOMIC_RELAXED);
+    if (n != (ssize_t)length)
+    {
+        printf("read error\n");
+        return -1;
+    }
+    __atomic_add_fetch(&disk->ioStats.bytesRead, n, __ATOMIC_RELAXED);
+    return (0);
+}
+
+int write_block_run(void *buffer, int k, int count)
+{
+    ssize_t n;
+    size_t length = (size_t)count * disk->blockSize;
+    if (disk->mappedDisk != NULL)
+    {
+        return mapped_io(buffer, k, length, 1);
+    }
+
+    n = pwrite(disk->vs_fd, buffer, length, (off_t)k * disk->blockSize);
+    __atomic_add_fetch(&disk->ioStats.writeCalls, 1, __ATOMIC_RELAXED);
+    if (n != (ssize_t)length)
+    {
+        printf("write error\n");
+        return -1;
+    }
+    __atomic_add_fetch(&disk->ioStats.bytesWritten, n, __ATOMIC_RELAXED);
+    return (0);
+}
+
+int write_block_vector(struct iovec *blocks, int k, int count)
+{
+    ssize_t n;
+    size_t length = (size_t)count * disk->blockSize;
+    n = pwritev(disk->vs_fd, blocks, count, (off_t)k * disk->blockSize);
+    __atomic_add_fetch(&disk->ioStats.writeCalls, 1, __ATOMIC_RELAXED);
+    if (n != (ssize_t)length)
+    {
+        printf("write error\n");
+        return -1;
+    }
+    __atomic_add_fetch(&disk->ioStats.bytesWritten, n, __ATOMIC_RELAXED);
+    return (0);
+}
+
 int vsformat(char *vdiskname, unsigned int m)
 {
+    return vsformatmode(vdiskname, m, FORMAT_SPARSE, BLOCKSIZE);
+}
+
+int vsformatmode(char *vdiskname, unsigned int m, int formatMode, int newBlockSize)
+{
+    // Formatting works on a disk of its own, a disk mounted by the calling thread is left alone
+    struct vsfs *fs = createDisk();
+    if (fs == NULL)
+    {
+        printf("ERROR: Could not allocate the disk!\n");
+        return -1;
+    }
+
+    struct vsfs *previous = selectDisk(fs);
+    int res = formatDisk(vdiskname, m, formatMode, newBlockSize);
+    selectDisk(previous);
+    destroyDisk(fs);
+    return res;
+}
+
+int formatDisk(char *vdiskname, unsigned int m, int formatMode, int newBlockSize)
+{
+    if (m < MIN_DISK_SIZE_SHIFT || m > MAX_DISK_SIZE_SHIFT)
+    {
+        printf("ERROR: The disk size must be between 2^%d and 2^%d bytes!\n", MIN_DISK_SIZE_SHIFT, MAX_DISK_SIZE_SHIFT);
+        return -1;
+    }
+    if (setBlockSize(newBlockSize) == -1)
+    {
+        printf("ERROR: The block size must be a power of two between %d and %d bytes!\n", MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+        return -1;
+    }
+
+    if ((int)m - disk->blockShift > MAX_DISK_BLOCK_SHIFT)
+    {
+        printf("ERROR: The disk can't have more than 2^%d blocks, use blocks of at least %d bytes!\n", MAX_DISK_BLOCK_SHIFT, 1 << (m - MAX_DISK_BLOCK_SHIFT));
+        return -1;
+    }
+
     // Meta information operations
-    char command[1000];
-    int size;
-    int num = 1;
-    int count;
-    size = num << m;
-    count = size / BLOCKSIZE;
-    sprintf(command, "dd if=/dev/zero of=%s bs=%d count=%d",
-            vdiskname, BLOCKSIZE, count);
-    system(command);
-
-    // Open file decriptor
-    vs_fd = open(vdiskname, O_RDWR);
-
-    // Initialize Super blocks on virtual disk
-    initializeSuperBlock(count);
-    // Initialize FAT entry blocks on virtual disk
-    initializeFatBlocks(count);
-    // Initialize Root Directory entry blocks on virtual disk
-    initializeRootDirectoryBlocks();
+    long long size = 1LL << m;
+    int count = (int)(size >> disk->blockShift);
 
-    // Synchronize memory & disk then close descriptor
-    fsync(vs_fd);
-    close(vs_fd);
+    // One FAT entry per block of the disk
+    setDiskLayout((count + disk->fatEntriesPerBlock - 1) >> disk->fatEntryShift);
+    if (disk->metadataBlockCount >= count)
+    {
+        printf("ERROR: The disk is too small for its metadata!\n");
+        return -1;
+    }
+
+    // A truncated file reads as zeros, so the journal and the unused entries need no writes
+    disk->vs_fd = open(vdiskname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (disk->vs_fd == -1)
+    {
+        printf("ERROR: Could not create the virtual disk!\n");
+        return -1;
+    }
+    if (ftruncate(disk->vs_fd, (off_t)size) == -1 ||
+        (formatMode == FORMAT_PREALLOCATE && posix_fallocate(disk->vs_fd, 0, (off_t)size) != 0))
+    {
+        printf("ERROR: Could not allocate the virtual disk!\n");
+        close(disk->vs_fd);
+        return -1;
+    }
+
+    // Initialize the superblock and FAT blocks on virtual disk, then synchronize memory & disk
+    if (initializeMetadataBlocks(count) == -1 || fsync(disk->vs_fd) == -1)
+    {
+        printf("ERROR: Could not write the metadata of the virtual disk!\n");
+        close(disk->vs_fd);
+        return -1;
+    }
+    close(disk->vs_fd);
     return (0);
 }
 
 int vsmount(char *vdiskname)
+{
+    return vsmountmode(vdiskname, MOUNT_FD);
+}
+
+int vsmountmode(char *vdiskname, int mountMode)
 {
     // Open file descriptor "globally"
-    vs_fd = open(vdiskname, O_RDWR);
+    disk->vs_fd = open(vdiskname, O_RDWR);
+    if (disk->vs_fd == -1)
+    {
+        printf("ERROR: Could not open the virtual disk!\n");
+        return -1;
+    }
+
+    vsresetstats();
+
+    // Map the whole virtual disk, the descriptor is the fallback
+    disk->mappedDisk = NULL;
+    if (mountMode == MOUNT_MMAP && mapVirtualDisk() == -1)
+    {
+        printf("WARNING: Could not map the virtual disk, using the file descriptor!\n");
+    }
+
+    // Read super block information on virtual disk to memory, FAT pages are loaded when first used
+    if (getSuperblock() == -1 || createFatTable() == -1)
+    {
+        unmapVirtualDisk();
+        close(disk->vs_fd);
+        return -1;
+    }
+
+    // Load the home metadata blocks and replay transactions committed after the last checkpoint
+    if (loadJournaledMetadata() == -1 || replayJournal() == -1)
+    {
+        printf("ERROR: Could not recover the metadata journal!\n");
+        destroyDirectory();
+        destroyFatTable();
+        unmapVirtualDisk();
+        close(disk->vs_fd);
+        return -1;
+    }
+    disk->freeBlockCount = disk->journaledFreeBlockCount;
+    disk->fileCount = disk->journaledFileCount;
 
-    // Read super block information on virtual disk to memory
-    getSuperblock();
-    // Read FAT entries on virtual disk to memory cache
+    // Pages read for recovery start from the replayed entries
     cacheFatTable();
     // Read Root Directory entries on virtual disk to memory cache
-    cacheRootDirectory();
+    if (cacheRootDirectory() == -1 || buildFilenameIndex() == -1)
+    {
+        printf("ERROR: Could not allocate the directory!\n");
+        destroyDirectory();
+        destroyFatTable();
+        unmapVirtualDisk();
+        close(disk->vs_fd);
+        return -1;
+    }
+    memset(disk->fatBlockDirty, 0, disk->fatBlockCount);
+    memset(disk->rootDirBlockDirty, 0, sizeof(disk->rootDirBlockDirty));
+    disk->rootDirBlockDirtyCount = 0;
 
     // Clear (initialize) the system wide open file table
     clearOpenFileTable();
+
+    // Allocate the data block buffer cache, the mapping serves data blocks directly
+    if (disk->mappedDisk == NULL && initializeBufferCache() == -1)
+    {
+        printf("ERROR: Could not allocate the buffer cache!\n");
+        destroyDirectory();
+        destroyFatTable();
+        unmapVirtualDisk();
+        close(disk->vs_fd);
+        return -1;
+    }
+
+    disk->diskMounted = 1;
+    if (disk->flushPolicy == FLUSH_PERIODIC)
+    {
+        startFlushThread();
+    }
     return (0);
 }
 
 int vsumount()
 {
-    // Write super block information on memory to virtual disk
-    setSuperblock();
-    // Write FAT entries on memory cache to virtual disk
-    flushCachedFatTable();
-    // Write Root Directory entries on memory cache to virtual disk
-    flushCachedRootDirectory();
+    stopFlushThread();
 
     // Close all file descriptors on Open File Table
-    for (int i = 0; i < MAX_NOF_OPEN_FILES; i++)
+    for (int i = 0; i < disk->openFileTableSize; i++)
     {
-        if (openFileTable[i].dirBlock > -1)
+        if (getOpenFile(i)->dirBlock > -1)
         {
             vsclose(i);
         }
     }
+    destroyOpenFileTable();
+
+    // Commit the last changes, then move everything from the journal to the home blocks
+    flushMetadata();
+    pthread_mutex_lock(&disk->metadataFlushLock);
+    checkpointJournal();
+    pthread_mutex_unlock(&disk->metadataFlushLock);
+
+    // Reads still in flight finish, completions not polled are dropped
+    stopAsyncBackend();
+
+    // Release the buffer cache or mapping
+    destroyBufferCache();
+    unmapVirtualDisk();
+    destroyDirectory();
+    destroyFatTable();
 
     // Synchronize memory & disk then close descriptor
-    fsync(vs_fd);
-    close(vs_fd);
+    fsync(disk->vs_fd);
+    close(disk->vs_fd);
+    disk->diskMounted = 0;
     return (0);
 }
 
 int vscreate(char *filename)
 {
-    // Check number of available files on root directory
-    if (fileCount == DIR_ENTRY_COUNT)
+    return createPath(filename, TYPE_FILE);
+}
+
+int vsmkdir(char *dirname)
+{
+    return createPath(dirname, TYPE_DIRECTORY);
+}
+
+int createPath(char *path, int type)
+{
+    pthread_mutex_lock(&disk->namespaceLock);
+    pthread_rwlock_rdlock(&disk->transactionLock);
+    int res = createFile(path, type);
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_mutex_unlock(&disk->namespaceLock);
+
+    // Bound the directory records of one transaction by the size of the journal
+    pthread_mutex_lock(&disk->directoryLock);
+    int dirtyBlocks = disk->rootDirBlockDirtyCount;
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    if (res == 0 && (disk->flushPolicy == FLUSH_IMMEDIATE || dirtyBlocks >= DIR_DIRTY_BLOCK_LIMIT))
+    {
+        flushMetadata();
+    }
+    return res;
+}
+
+int vsopen(char *file, int mode)
+{
+    pthread_mutex_lock(&disk->namespaceLock);
+    int fd = openFile(file, mode);
+    pthread_mutex_unlock(&disk->namespaceLock);
+    return fd;
+}
+
+int vsclose(int fd)
+{
+    // Held appends get their blocks before the descriptor goes away
+    if (flushDelayedAppends(fd) == -1)
     {
-        printf("ERROR: No capacity available for file creation!\n");
         return -1;
     }
 
-    // Check same named file existence
-    for (int i = 0; i < DIR_ENTRY_COUNT; i++)
+    pthread_mutex_lock(&disk->namespaceLock);
+    int res = closeFile(fd);
+    pthread_mutex_unlock(&disk->namespaceLock);
+
+    // Write back data appended through this descriptor
+    if (res == 0 && disk->flushPolicy == FLUSH_ON_CLOSE)
     {
-        if (cachedRootDirectory[i].allocated == USED_FLAG && strcmp(cachedRootDirectory[i].filename, filename) == 0)
-        {
-            printf("ERROR: File with the same name already created!\n");
-            return -1;
-        }
+        flushMetadata();
+    }
+    else if (res == 0)
+    {
+        flushDirtyData();
     }
+    return res;
+}
 
-    // Check for empty data block
-    int blockIndex = findAvailableBlockIndex();
-    if (blockIndex == -1)
+int vssize(int fd)
+{
+    struct dirEntry *tmpDirEntry = lockFileOfDescriptor(fd, 0);
+    if (tmpDirEntry == NULL)
     {
-        printf("ERROR: No empty data blocks, can not create a new file!\n");
+        printf("ERROR: File not opened yet!\n");
         return -1;
     }
 
-    // Find empty Directory Root poisiton on cachedRootDirectory
-    int availableDirectoryEntryIndex = findAvailableDirectoryEntryIndex();
+    int size = tmpDirEntry->size + tmpDirEntry->delayedSize;
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
 
-    // Check non-empty root directory anomaly (Trivial)
-    if (availableDirectoryEntryIndex == -1)
+    if (size < 0)
     {
-        printf("ERROR: No empty root directory was found (Anomaly)!\n");
+        printf("ERROR: The file does not have a valid size!\n");
         return -1;
     }
 
-    // Allocate a new data block for file
-    allocateBlockFatEntry(blockIndex, EOF_FLAG);
-
-    // Decrement free block count
-    freeBlockCount--;
-
-    // Allocate a new directory entry
-    allocateDirectoryEntry(availableDirectoryEntryIndex, filename, 0, blockIndex, USED_FLAG);
-    // Increment the number of files
-    fileCount++;
-
-    return (0);
+    return size;
 }
 
-int vsopen(char *file, int mode)
+int vsread(int fd, void *buf, int n)
 {
-    // Check limit of opening files
-    if (openFileCount == MAX_NOF_OPEN_FILES)
+    // Check correctness of n
+    if (n < 0)
     {
-        printf("ERROR: Can't open more files!\n");
+        printf("ERROR: n can't take a negative value! %d\n", n);
         return -1;
     }
 
-    // Check maximum number of files opened
-    for (int i = 0; i < MAX_NOF_OPEN_FILES; i++)
+    // Reads move the position and block cursor of the descriptor, readers of the file share it
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL)
     {
-        char *filename = cachedRootDirectory[openFileTable[i].cachedRootDirIndex].filename;
-        if (openFileTable[i].dirBlock > -1 && strcmp(filename, file) == 0)
-        {
-            printf("ERROR: File already opened!\n");
-            return -1;
-        }
+        printf("ERROR: File not opened yet!\n");
+        return -1;
     }
 
-    // Find space in the open file table
-    int fd = findAvailableOpenFileTableIndex();
-
-    if (fd == -1)
+    int res = readFromFile(fd, buf, n, getOpenFile(fd)->positionPtr);
+    if (res != -1)
     {
-        printf("ERROR: Could not find available open file table entry (Anomaly)!\n");
+        // Increment the file pointer
+        getOpenFile(fd)->positionPtr += res;
     }
+    unlockFileForReading(fd, tmpDirEntry);
+    return res;
+}
 
-    // Find in the root directory structure by filename
-    int directoryEntryIndex = findDirectoryEntryIndexByFilename(file);
-
-    if (directoryEntryIndex == -1)
+int vspread(int fd, void *buf, int n, int offset)
+{
+    if (n < 0 || offset < 0 || offset > INT_MAX - n)
     {
-        printf("ERROR: Could not find the file with the given name!\n");
+        printf("ERROR: n and offset can't take negative values! %d %d\n", n, offset);
+        return -1;
     }
 
-    // Allocate open file table entry
-    allocateOpenFileTableEntry(fd, directoryEntryIndex, mode);
-
-    return fd;
-}
-
-int vsclose(int fd)
-{
-    // Check if file is opened
-    if (openFileTable[fd].dirBlock == -1)
+    // The position stays, the block cursor still moves
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL)
     {
-        printf("ERROR: File not opened yet\n");
+        printf("ERROR: File not opened yet!\n");
         return -1;
     }
 
-    // Make related open file table available
-    openFileTable[fd].dirBlock = -1;
-    // Decrement open file count
-    openFileCount--;
-    return (0);
+    int res = readFromFile(fd, buf, n, offset);
+    unlockFileForReading(fd, tmpDirEntry);
+    return res;
 }
 
-int vssize(int fd)
+int vsseek(int fd, int offset)
 {
-    if (openFileTable[fd].dirBlock == -1)
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL)
     {
         printf("ERROR: File not opened yet!\n");
         return -1;
     }
 
-    int size = cachedRootDirectory[openFileTable[fd].cachedRootDirIndex].size;
-    if (size < 0)
+    // Appends always go to the end, only readers have a position to move
+    if (getOpenFile(fd)->accessMode == MODE_APPEND || offset < 0 || offset > tmpDirEntry->size)
     {
-        printf("ERROR: The file does not have a valid size!\n");
+        unlockFileForReading(fd, tmpDirEntry);
+        printf("ERROR: Can't seek to %d!\n", offset);
         return -1;
     }
 
-    return size;
+    getOpenFile(fd)->positionPtr = offset;
+    unlockFileForReading(fd, tmpDirEntry);
+    return offset;
 }
 
-int vsread(int fd, void *buf, int n)
+int vsreadview(int fd, int n, struct iovec **iov, int *cnt)
 {
-    if (openFileTable[fd].dirBlock == -1)
+    if (n <= 0)
+    {
+        printf("ERROR: n must be positive! %d\n", n);
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL)
     {
         printf("ERROR: File not opened yet!\n");
         return -1;
     }
 
-    // Check the correct mode
-    if (openFileTable[fd].accessMode == MODE_APPEND)
+    int res = createReadView(fd, n, iov, cnt);
+    unlockFileForReading(fd, tmpDirEntry);
+    return res;
+}
+
+int vsreleaseview(int fd)
+{
+    // The view belongs to the descriptor, taken like vsreadview so readers of it don't see it change
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL || getOpenFile(fd)->view == NULL)
     {
-        printf("ERROR: can't read in APPEND mode!\n");
+        if (tmpDirEntry != NULL)
+        {
+            unlockFileForReading(fd, tmpDirEntry);
+        }
+        printf("ERROR: No view to release!\n");
         return -1;
     }
 
-    // get the data about the directory entry
-    struct dirEntry *tmpDirEntry = &(cachedRootDirectory[openFileTable[fd].cachedRootDirIndex]);
-    int logicalStartOffset = openFileTable[fd].positionPtr;
-    int logicalEndOffset = logicalStartOffset + n;
+    releaseReadView(fd);
+    unlockFileForReading(fd, tmpDirEntry);
+    return (0);
+}
 
-    if (tmpDirEntry->size < logicalEndOffset)
+void releaseReadView(int fd)
+{
+    for (int i = 0; i < getOpenFile(fd)->viewBlockCount; i++)
     {
-        printf("ERROR: Cannot reads n bytes exceeding file size!\n");
+        releaseCachedBlock(getOpenFile(fd)->viewBlocks[i]);
+    }
+    releaseViewPins(getOpenFile(fd)->viewBlockCount);
+
+    free(getOpenFile(fd)->view);
+    free(getOpenFile(fd)->viewBlocks);
+    free(getOpenFile(fd)->viewCopy);
+    getOpenFile(fd)->view = NULL;
+    getOpenFile(fd)->viewBlocks = NULL;
+    getOpenFile(fd)->viewBlockCount = 0;
+    getOpenFile(fd)->viewCopy = NULL;
+    __atomic_sub_fetch(&(getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex)->viewCount), 1, __ATOMIC_SEQ_CST);
+}
+
+int vsappend(int fd, void *buf, int n)
+{
+    // Check correctness of n
+    if (n <= 0)
+    {
+        printf("ERROR: n can't take a negative value! %d\n", n);
         return -1;
     }
 
-    // find the block range for acessing data in the file
-    int logicalStartBlock = logicalStartOffset / BLOCKSIZE;
-    int logicalStartBlockOffset = logicalStartOffset % BLOCKSIZE;
+    // Appends are exclusive with every other access to the file
+    struct dirEntry *tmpDirEntry = lockFileOfDescriptor(fd, 1);
+    if (tmpDirEntry == NULL)
+    {
+        printf("ERROR: file must opened first!\n");
+        return -1;
+    }
 
-    int logicalEndBlock = logicalEndOffset / BLOCKSIZE;
-    int logicalEndBlockOffset = logicalEndOffset % BLOCKSIZE;
+    pthread_rwlock_rdlock(&disk->transactionLock);
+    int res = appendToFile(fd, buf, n, NULL);
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
 
-    int byteCount = 0;
-    void *bufferPtr = buf;
+    if (res != -1 && disk->flushPolicy == FLUSH_IMMEDIATE)
+    {
+        flushMetadata();
+    }
+    return res;
+}
 
-    // Single Block Read
-    if (logicalStartBlock == logicalEndBlock)
+int flushDelayedAppends(int fd)
+{
+    struct dirEntry *tmpDirEntry = lockFileOfDescriptor(fd, 1);
+    if (tmpDirEntry == NULL)
     {
-        readFromBlockToBuffer(bufferPtr, tmpDirEntry->startBlock, logicalStartBlockOffset, logicalEndBlockOffset, &byteCount);
+        return (0);
     }
-    else
+
+    pthread_rwlock_rdlock(&disk->transactionLock);
+    int res = writeDelayedAppends(fd);
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
+    return res;
+}
+
+void flushAllDelayedAppends()
+{
+    // Descriptors of other threads can't be closed or reused while the table is walked
+    pthread_mutex_lock(&disk->namespaceLock);
+    for (int fd = 0; fd < disk->openFileTableSize; fd++)
     {
-        int blockPtr = tmpDirEntry->startBlock;
-        for (int i = logicalStartBlock; i < logicalEndBlock; i++)
+        // Held bytes belong to the file, its first descriptor writes them
+        if (getOpenFile(fd)->dirBlock > -1 && getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex)->openDescriptor == fd)
         {
-            if (blockPtr == -1)
-            {
-                printf("ERROR(CRITICAL): can't fetch the block in range to read/ not allocated yet!\n");
-                return -1;
-            }
+            flushDelayedAppends(fd);
+        }
+    }
+    pthread_mutex_unlock(&disk->namespaceLock);
+}
 
-            // Start partial block read
-            if (i == logicalStartBlock)
+int vsreadasync(int fd, void *buf, int n, int offset, void *userData)
+{
+    if (n < 0 || offset < 0 || offset > INT_MAX - n)
+    {
+        printf("ERROR: n and offset can't take negative values! %d %d\n", n, offset);
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = lockFileForReading(fd);
+    if (tmpDirEntry == NULL)
+    {
+        printf("ERROR: File not opened yet!\n");
+        return -1;
+    }
+
+    // Blocks are mapped now, the data arrives with the completion
+    struct asyncRequest *request = createAsyncRequest(tmpDirEntry, 0, userData);
+    int res = (request != NULL) ? readFromFileAsync(fd, buf, n, offset, request) : -1;
+    res = (request != NULL) ? finishAsyncRequest(request, res) : -1;
+    unlockFileForReading(fd, tmpDirEntry);
+    return res;
+}
+
+int vsappendasync(int fd, void *buf, int n, void *userData)
+{
+    if (n <= 0)
+    {
+        printf("ERROR: n can't take a negative value! %d\n", n);
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = lockFileOfDescriptor(fd, 1);
+    if (tmpDirEntry == NULL)
+    {
+        printf("ERROR: file must opened first!\n");
+        return -1;
+    }
+
+    // Blocks are allocated now, runs of full blocks are written with the completion
+    pthread_rwlock_rdlock(&disk->transactionLock);
+    struct asyncRequest *request = createAsyncRequest(tmpDirEntry, 1, userData);
+    int res = (request != NULL) ? appendToFile(fd, buf, n, request) : -1;
+    res = (request != NULL) ? finishAsyncRequest(request, res) : -1;
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
+
+    if (res != -1 && disk->flushPolicy == FLUSH_IMMEDIATE)
+    {
+        flushMetadata();
+    }
+    return res;
+}
+
+int vspoll(struct vsCompletion *completions, int maxCompletions)
+{
+    return vswait(completions, maxCompletions, 0);
+}
+
+int vswait(struct vsCompletion *completions, int maxCompletions, int minCompletions)
+{
+    pthread_mutex_lock(&disk->asyncLock);
+
+    // Never wait for more requests than were submitted
+    int outstanding = disk->asyncReadyCount + disk->asyncRequestsInFlight;
+    minCompletions = (minCompletions < maxCompletions) ? minCompletions : maxCompletions;
+    minCompletions = (minCompletions < outstanding) ? minCompletions : outstanding;
+    reapAsyncCompletions();
+    while (disk->asyncReadyCount < minCompletions)
+    {
+        waitAsyncProgress();
+    }
+
+    int count = 0;
+    while (count < maxCompletions && disk->asyncReadyHead != NULL)
+    {
+        struct asyncRequest *request = disk->asyncReadyHead;
+        disk->asyncReadyHead = request->next;
+        disk->asyncReadyTail = (disk->asyncReadyHead != NULL) ? disk->asyncReadyTail : NULL;
+        disk->asyncReadyCount--;
+        completions[count].userData = request->userData;
+        completions[count].result = request->result;
+        count++;
+        free(request);
+    }
+    pthread_mutex_unlock(&disk->asyncLock);
+    return count;
+}
+
+int vssetasyncbackend(int backend)
+{
+    if (backend != ASYNC_IO_URING && backend != ASYNC_THREAD_POOL)
+    {
+        printf("ERROR: Unknown asynchronous backend %d!\n", backend);
+        return -1;
+    }
+
+    // Takes effect on the next vsmount
+    disk->asyncBackendSetting = backend;
+    return (0);
+}
+
+int vsgetasyncbackend()
+{
+    // The backend running, or the one the next request starts
+    pthread_mutex_lock(&disk->asyncLock);
+    int backend = (disk->asyncBackend != -1) ? disk->asyncBackend : disk->asyncBackendSetting;
+    pthread_mutex_unlock(&disk->asyncLock);
+    return backend;
+}
+
+int vsdelete(char *filename)
+{
+    pthread_mutex_lock(&disk->namespaceLock);
+    int res = deleteFile(filename);
+    pthread_mutex_unlock(&disk->namespaceLock);
+
+    // Blocks of the file can be reused once the delete is committed
+    if (res == 0)
+    {
+        flushMetadata();
+    }
+    return res;
+}
+
+int vsrmdir(char *dirname)
+{
+    pthread_mutex_lock(&disk->namespaceLock);
+    pthread_rwlock_rdlock(&disk->transactionLock);
+    int res = removeDirectory(dirname);
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_mutex_unlock(&disk->namespaceLock);
+
+    if (res == 0 && disk->flushPolicy == FLUSH_IMMEDIATE)
+    {
+        flushMetadata();
+    }
+    return res;
+}
+
+int vsreaddir(char *dirname, struct vsDirent *entries, int maxEntries)
+{
+    if (maxEntries < 0)
+    {
+        printf("ERROR: maxEntries can't take a negative value! %d\n", maxEntries);
+        return -1;
+    }
+
+    pthread_mutex_lock(&disk->namespaceLock);
+    int res = readDirectory(dirname, entries, maxEntries);
+    pthread_mutex_unlock(&disk->namespaceLock);
+    return res;
+}
+
+// Disks of their own, the vsfs* calls work on the disk passed to them instead of the one of the calling thread
+
+vsfs_t *vsfsmount(char *vdiskname, int mountMode)
+{
+    // Settings are inherited from the disk of the calling thread
+    struct vsfs *fs = createDisk();
+    if (fs == NULL)
+    {
+        printf("ERROR: Could not allocate the disk!\n");
+        return NULL;
+    }
+
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsmountmode(vdiskname, mountMode);
+    selectDisk(previous);
+    if (res == -1)
+    {
+        destroyDisk(fs);
+        return NULL;
+    }
+    return fs;
+}
+
+int vsfsumount(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsumount();
+    selectDisk(previous);
+    destroyDisk(fs);
+    return res;
+}
+
+int vsfscreate(vsfs_t *fs, char *filename)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vscreate(filename);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsopen(vsfs_t *fs, char *filename, int mode)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsopen(filename, mode);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsclose(vsfs_t *fs, int fd)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsclose(fd);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfssize(vsfs_t *fs, int fd)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vssize(fd);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsread(vsfs_t *fs, int fd, void *buf, int n)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsread(fd, buf, n);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfspread(vsfs_t *fs, int fd, void *buf, int n, int offset)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vspread(fd, buf, n, offset);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsseek(vsfs_t *fs, int fd, int offset)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsseek(fd, offset);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsreadview(vsfs_t *fs, int fd, int n, struct iovec **iov, int *cnt)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsreadview(fd, n, iov, cnt);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsreleaseview(vsfs_t *fs, int fd)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsreleaseview(fd);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsappend(vsfs_t *fs, int fd, void *buf, int n)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsappend(fd, buf, n);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsreadasync(vsfs_t *fs, int fd, void *buf, int n, int offset, void *userData)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsreadasync(fd, buf, n, offset, userData);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsappendasync(vsfs_t *fs, int fd, void *buf, int n, void *userData)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsappendasync(fd, buf, n, userData);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfspoll(vsfs_t *fs, struct vsCompletion *completions, int maxCompletions)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vspoll(completions, maxCompletions);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfswait(vsfs_t *fs, struct vsCompletion *completions, int maxCompletions, int minCompletions)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vswait(completions, maxCompletions, minCompletions);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsdelete(vsfs_t *fs, char *filename)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsdelete(filename);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsmkdir(vsfs_t *fs, char *dirname)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsmkdir(dirname);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsrmdir(vsfs_t *fs, char *dirname)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsrmdir(dirname);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsreaddir(vsfs_t *fs, char *dirname, struct vsDirent *entries, int maxEntries)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsreaddir(dirname, entries, maxEntries);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfssync(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vssync();
+    selectDisk(previous);
+    return res;
+}
+
+int vsfsgetblocksize(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsgetblocksize();
+    selectDisk(previous);
+    return res;
+}
+
+void vsfsgetiostats(vsfs_t *fs, struct vsIoStats *stats)
+{
+    struct vsfs *previous = selectDisk(fs);
+    vsgetiostats(stats);
+    selectDisk(previous);
+}
+
+void vsfsresetstats(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    vsresetstats();
+    selectDisk(previous);
+}
+
+void vsfsgetcachestats(vsfs_t *fs, struct vsCacheStats *stats)
+{
+    struct vsfs *previous = selectDisk(fs);
+    vsgetcachestats(stats);
+    selectDisk(previous);
+}
+
+int vsfssetflushpolicy(vsfs_t *fs, int policy, int intervalMs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vssetflushpolicy(policy, intervalMs);
+    selectDisk(previous);
+    return res;
+}
+
+int vsfssetallocationwindow(vsfs_t *fs, int blockCount)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vssetallocationwindow(blockCount);
+    selectDisk(previous);
+    return res;
+}
+
+void vsfsfragreport(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    vsfragreport();
+    selectDisk(previous);
+}
+
+int vsfsgetasyncbackend(vsfs_t *fs)
+{
+    struct vsfs *previous = selectDisk(fs);
+    int res = vsgetasyncbackend();
+    selectDisk(previous);
+    return res;
+}
+
+struct vsfs *createDisk()
+{
+    struct vsfs *fs = calloc(1, sizeof(struct vsfs));
+    if (fs == NULL)
+    {
+        return NULL;
+    }
+
+    fs->blockSize = BLOCKSIZE;
+    fs->asyncBackendSetting = disk->asyncBackendSetting;
+    fs->asyncBackend = -1;
+    fs->flushPolicy = disk->flushPolicy;
+    fs->flushInterval = disk->flushInterval;
+    fs->allocationWindow = disk->allocationWindow;
+    fs->bufferCacheSize = disk->bufferCacheSize;
+    pthread_mutex_init(&fs->namespaceLock, NULL);
+    pthread_mutex_init(&fs->directoryLock, NULL);
+    pthread_mutex_init(&fs->allocatorLock, NULL);
+    pthread_mutex_init(&fs->fatPageLock, NULL);
+    pthread_mutex_init(&fs->cacheLock, NULL);
+    pthread_cond_init(&fs->cacheSlotReady, NULL);
+    pthread_mutex_init(&fs->metadataFlushLock, NULL);
+    pthread_rwlock_init(&fs->transactionLock, NULL);
+    pthread_mutex_init(&fs->flushThreadLock, NULL);
+    pthread_cond_init(&fs->flushThreadWake, NULL);
+    pthread_mutex_init(&fs->asyncLock, NULL);
+    pthread_cond_init(&fs->asyncWork, NULL);
+    pthread_cond_init(&fs->asyncDone, NULL);
+    return fs;
+}
+
+void destroyDisk(struct vsfs *fs)
+{
+    pthread_mutex_destroy(&fs->namespaceLock);
+    pthread_mutex_destroy(&fs->directoryLock);
+    pthread_mutex_destroy(&fs->allocatorLock);
+    pthread_mutex_destroy(&fs->fatPageLock);
+    pthread_mutex_destroy(&fs->cacheLock);
+    pthread_cond_destroy(&fs->cacheSlotReady);
+    pthread_mutex_destroy(&fs->metadataFlushLock);
+    pthread_rwlock_destroy(&fs->transactionLock);
+    pthread_mutex_destroy(&fs->flushThreadLock);
+    pthread_cond_destroy(&fs->flushThreadWake);
+    pthread_mutex_destroy(&fs->asyncLock);
+    pthread_cond_destroy(&fs->asyncWork);
+    pthread_cond_destroy(&fs->asyncDone);
+    free(fs);
+}
+
+struct vsfs *selectDisk(struct vsfs *fs)
+{
+    struct vsfs *previous = disk;
+    disk = fs;
+    return previous;
+}
+
+// File operations, called with the locks taken by the public functions above
+
+struct dirEntry *lockFileOfDescriptor(int fd, int exclusive)
+{
+    // The open is identified by its generation, taken before the descriptor is checked
+    if (fd < 0 || fd >= __atomic_load_n(&disk->openFileTableSize, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    struct fileStruct *file = getOpenFile(fd);
+    int generation = __atomic_load_n(&(file->generation), __ATOMIC_ACQUIRE);
+    int cacheIndex = __atomic_load_n(&(file->cachedRootDirIndex), __ATOMIC_RELAXED);
+    if (!isOpenDescriptor(fd))
+    {
+        return NULL;
+    }
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    if (exclusive)
+    {
+        pthread_rwlock_wrlock(&(tmpDirEntry->lock));
+    }
+    else
+    {
+        pthread_rwlock_rdlock(&(tmpDirEntry->lock));
+    }
+
+    // The file may have been deleted while waiting for the lock, and the descriptor closed or reused by another open
+    if (!isOpenDescriptor(fd) || __atomic_load_n(&(file->generation), __ATOMIC_ACQUIRE) != generation ||
+        __atomic_load_n(&(file->cachedRootDirIndex), __ATOMIC_RELAXED) != cacheIndex)
+    {
+        pthread_rwlock_unlock(&(tmpDirEntry->lock));
+        return NULL;
+    }
+
+    return tmpDirEntry;
+}
+
+struct dirEntry *lockFileForReading(int fd)
+{
+    // Readers share the file, bytes held back for appends of another descriptor are written first
+    struct dirEntry *tmpDirEntry = lockFileOfDescriptor(fd, 0);
+    if (tmpDirEntry != NULL && tmpDirEntry->delayedSize > 0)
+    {
+        pthread_rwlock_unlock(&(tmpDirEntry->lock));
+        flushDelayedAppends(fd);
+        tmpDirEntry = lockFileOfDescriptor(fd, 0);
+    }
+
+    // Position, cursor and view belong to the descriptor
+    if (tmpDirEntry != NULL)
+    {
+        pthread_mutex_lock(&(getOpenFile(fd)->lock));
+    }
+    return tmpDirEntry;
+}
+
+void unlockFileForReading(int fd, struct dirEntry *tmpDirEntry)
+{
+    pthread_mutex_unlock(&(getOpenFile(fd)->lock));
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
+}
+
+int createFile(char *filename, int type)
+{
+    // The parent directory has to exist, the last component is the new name
+    int parentIndex;
+    char name[MAX_FILENAME_LENGTH];
+    if (resolveParentDirectory(filename, &parentIndex, name) == -1)
+    {
+        return -1;
+    }
+
+    // Check same named file existence
+    if (findChildEntryIndex(parentIndex, name) != -1)
+    {
+        printf("ERROR: File with the same name already created!\n");
+        return -1;
+    }
+
+    // Find empty Directory Root poisiton on cachedRootDirectory, the directory grows when it is full
+    int availableDirectoryEntryIndex = findAvailableDirectoryEntryIndex();
+
+    if (availableDirectoryEntryIndex == -1)
+    {
+        printf("ERROR: No capacity available for file creation!\n");
+        return -1;
+    }
+
+    // Allocate a new directory entry, files keep their data in it until it outgrows INLINE_DATA_MAX.
+    // Directories have no data blocks, their entries point at them.
+    allocateDirectoryEntry(availableDirectoryEntryIndex, name, 0, -1, USED_FLAG, parentIndex, type);
+    insertFilenameIndex(availableDirectoryEntryIndex);
+    getDirectoryEntry(availableDirectoryEntryIndex)->lastBlock = -1;
+    getDirectoryEntry(availableDirectoryEntryIndex)->blockCount = 0;
+    // Increment the number of files, directories are counted as well
+    __atomic_add_fetch(&disk->fileCount, 1, __ATOMIC_RELAXED);
+
+    return (0);
+}
+
+int openFile(char *file, int mode)
+{
+    // Find in the directory tree by path
+    int directoryEntryIndex = findDirectoryEntryIndexByPath(file);
+
+    if (directoryEntryIndex == -1)
+    {
+        printf("ERROR: Could not find the file with the given name!\n");
+        return -1;
+    }
+
+    if (getDirectoryEntry(directoryEntryIndex)->type != TYPE_FILE)
+    {
+        printf("ERROR: Can't open a directory!\n");
+        return -1;
+    }
+
+    // Find space in the open file table, a file may be open on any number of descriptors
+    int fd = findAvailableOpenFileTableIndex();
+
+    if (fd == -1)
+    {
+        printf("ERROR: Can't open more files!\n");
+        return -1;
+    }
+
+    // Allocate open file table entry
+    allocateOpenFileTableEntry(fd, directoryEntryIndex, mode);
+
+    return fd;
+}
+
+int closeFile(int fd)
+{
+    // Check if file is opened
+    if (!isOpenDescriptor(fd))
+    {
+        printf("ERROR: File not opened yet\n");
+        return -1;
+    }
+
+    // Spans of an outstanding view are not valid after close, a reader still using the descriptor finishes first
+    pthread_mutex_lock(&(getOpenFile(fd)->lock));
+    if (getOpenFile(fd)->view != NULL)
+    {
+        releaseReadView(fd);
+    }
+
+    // Unlink from the descriptors of the file and make related open file table entry available
+    struct fileStruct *file = getOpenFile(fd);
+    if (file->prevOpen != -1)
+    {
+        getOpenFile(file->prevOpen)->nextOpen = file->nextOpen;
+    }
+    else
+    {
+        getDirectoryEntry(file->cachedRootDirIndex)->openDescriptor = file->nextOpen;
+    }
+    if (file->nextOpen != -1)
+    {
+        getOpenFile(file->nextOpen)->prevOpen = file->prevOpen;
+    }
+    __atomic_store_n(&(file->dirBlock), -1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&(file->lock));
+    disk->freeDescriptors[disk->freeDescriptorCount++] = fd;
+    // Decrement open file count
+    disk->openFileCount--;
+    return (0);
+}
+
+int readFromFile(int fd, void *buf, int n, int offset)
+{
+    // Check the correct mode
+    if (getOpenFile(fd)->accessMode == MODE_APPEND)
+    {
+        printf("ERROR: can't read in APPEND mode!\n");
+        return -1;
+    }
+
+    // get the data about the directory entry, blocks of asynchronous appends have to be on disk
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    waitForAsyncWrites(tmpDirEntry);
+    int logicalStartOffset = offset;
+    int logicalEndOffset = logicalStartOffset + n;
+
+    if (tmpDirEntry->size < logicalEndOffset)
+    {
+        printf("ERROR: Cannot reads n bytes exceeding file size!\n");
+        return -1;
+    }
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    // Small files are read from the directory entry
+    if (tmpDirEntry->startBlock == -1)
+    {
+        memcpy(buf, tmpDirEntry->inlineData + offset, n);
+        return n;
+    }
+
+    // find the block range for acessing data in the file
+    int logicalStartBlock = logicalStartOffset >> disk->blockShift;
+    int logicalStartBlockOffset = logicalStartOffset & (disk->blockSize - 1);
+
+    int logicalEndBlock = (logicalEndOffset - 1) >> disk->blockShift;
+    int logicalEndBlockOffset = logicalEndOffset - (logicalEndBlock << disk->blockShift);
+
+    int byteCount = 0;
+    void *bufferPtr = buf;
+
+    int i = logicalStartBlock;
+    while (i <= logicalEndBlock)
+    {
+        // Resume from the cursor of the descriptor instead of the start block
+        int blockPtr = findBlockOfFile(fd, i);
+        if (blockPtr == -1)
+        {
+            printf("ERROR(CRITICAL): can't fetch the block in range to read/ not allocated yet!\n");
+            return -1;
+        }
+
+        int startOffset = (i == logicalStartBlock) ? logicalStartBlockOffset : 0;
+        int endOffset = (i == logicalEndBlock) ? logicalEndBlockOffset : disk->blockSize;
+
+        // Full blocks that are also physically adjacent are read with a single call
+        if (startOffset == 0 && endOffset == disk->blockSize)
+        {
+            int lastFullBlock = (logicalEndBlockOffset == disk->blockSize) ? logicalEndBlock : logicalEndBlock - 1;
+            int runLength = 1;
+            while (i + runLength <= lastFullBlock && getFatEntry(blockPtr + runLength - 1) == blockPtr + runLength)
+            {
+                runLength++;
+            }
+
+            if (runLength >= VECTORED_IO_MIN_BLOCKS)
+            {
+                if (readBlockRunToBuffer((char *)bufferPtr + byteCount, blockPtr, runLength) == -1)
+                {
+                    printf("ERROR: Could not read n bytes!\n");
+                    return -1;
+                }
+                byteCount += runLength * disk->blockSize;
+
+                // Move the cursor to the last block of the run
+                findBlockOfFile(fd, i + runLength - 1);
+                i += runLength;
+                continue;
+            }
+        }
+
+        if (readFromBlockToBuffer(bufferPtr, blockPtr, startOffset, endOffset, &byteCount) == -1)
+        {
+            printf("ERROR: Could not read n bytes!\n");
+            return -1;
+        }
+        i++;
+    }
+
+    if (byteCount != n)
+    {
+        printf("ERROR: Could not read n bytes!\n");
+        return -1;
+    }
+
+    return byteCount;
+}
+
+int readFromFileAsync(int fd, char *buf, int n, int offset, struct asyncRequest *request)
+{
+    if (getOpenFile(fd)->accessMode == MODE_APPEND)
+    {
+        printf("ERROR: can't read in APPEND mode!\n");
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    waitForAsyncWrites(tmpDirEntry);
+    int logicalEndOffset = offset + n;
+    if (tmpDirEntry->size < logicalEndOffset)
+    {
+        printf("ERROR: Cannot reads n bytes exceeding file size!\n");
+        return -1;
+    }
+
+    if (tmpDirEntry->startBlock == -1)
+    {
+        memcpy(buf, tmpDirEntry->inlineData + offset, n);
+        return n;
+    }
+
+    // Cached blocks may be newer than the disk and are copied now, the others go to the backend,
+    // adjacent full blocks in one run
+    int logicalEndBlock = (logicalEndOffset - 1) >> disk->blockShift;
+    int byteCount = 0;
+    int runStart = -1;
+    int runLength = 0;
+    char *runBuffer = NULL;
+    for (int i = offset >> disk->blockShift; n > 0 && i <= logicalEndBlock; i++)
+    {
+        int blockPtr = findBlockOfFile(fd, i);
+        if (blockPtr == -1)
+        {
+            printf("ERROR(CRITICAL): can't fetch the block in range to read/ not allocated yet!\n");
+            return -1;
+        }
+
+        int startOffset = (i == offset >> disk->blockShift) ? offset & (disk->blockSize - 1) : 0;
+        int endOffset = (i == logicalEndBlock) ? logicalEndOffset - (i << disk->blockShift) : disk->blockSize;
+        char *destination = buf + byteCount;
+        byteCount += endOffset - startOffset;
+        int cached = (disk->mappedDisk == NULL) && copyCachedSpan(destination, blockPtr, startOffset, endOffset - startOffset) == 0;
+        if (!cached && endOffset - startOffset == disk->blockSize && runLength > 0 && blockPtr == runStart + runLength)
+        {
+            runLength++;
+            continue;
+        }
+
+        if (runLength > 0 && submitAsyncOperation(request, runBuffer, runStart, runLength, NULL, 0, 0) == -1)
+        {
+            return -1;
+        }
+        runLength = 0;
+        if (cached)
+        {
+            continue;
+        }
+
+        if (endOffset - startOffset == disk->blockSize)
+        {
+            runStart = blockPtr;
+            runLength = 1;
+            runBuffer = destination;
+        }
+        else if (submitAsyncOperation(request, NULL, blockPtr, 1, destination, startOffset, endOffset - startOffset) == -1)
+        {
+            return -1;
+        }
+    }
+
+    if (runLength > 0 && submitAsyncOperation(request, runBuffer, runStart, runLength, NULL, 0, 0) == -1)
+    {
+        return -1;
+    }
+    return n;
+}
+
+int createReadView(int fd, int n, struct iovec **iov, int *cnt)
+{
+    if (getOpenFile(fd)->accessMode == MODE_APPEND)
+    {
+        printf("ERROR: can't read in APPEND mode!\n");
+        return -1;
+    }
+
+    if (getOpenFile(fd)->view != NULL)
+    {
+        printf("ERROR: Release the previous view first!\n");
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    waitForAsyncWrites(tmpDirEntry);
+    int logicalStartOffset = getOpenFile(fd)->positionPtr;
+    int logicalEndOffset = logicalStartOffset + n;
+
+    if (tmpDirEntry->size < logicalEndOffset)
+    {
+        printf("ERROR: Cannot reads n bytes exceeding file size!\n");
+        return -1;
+    }
+
+    int logicalStartBlock = logicalStartOffset >> disk->blockShift;
+    int logicalEndBlock = (logicalEndOffset - 1) >> disk->blockShift;
+    int spanCapacity = logicalEndBlock - logicalStartBlock + 1;
+
+    // Views share part of the buffer cache, one that does not fit gets a copy of its bytes instead
+    int pinsSlots = tmpDirEntry->startBlock != -1 && disk->mappedDisk == NULL;
+    if (pinsSlots && reserveViewPins(spanCapacity) == -1)
+    {
+        return createCopiedView(fd, n, iov, cnt);
+    }
+
+    struct iovec *view = malloc(spanCapacity * sizeof(struct iovec));
+    struct cacheBlock **viewBlocks = malloc(spanCapacity * sizeof(struct cacheBlock *));
+    if (view == NULL || viewBlocks == NULL)
+    {
+        printf("ERROR: Could not allocate the view!\n");
+        releaseViewPins(pinsSlots ? spanCapacity : 0);
+        free(view);
+        free(viewBlocks);
+        return -1;
+    }
+    int spanCount = 0;
+    int pinnedCount = 0;
+
+    for (int i = logicalStartBlock; i <= logicalEndBlock; i++)
+    {
+        int blockPtr = findBlockOfFile(fd, i);
+        int startOffset = (i == logicalStartBlock) ? logicalStartOffset & (disk->blockSize - 1) : 0;
+        int endOffset = (i == logicalEndBlock) ? logicalEndOffset - (i << disk->blockShift) : disk->blockSize;
+        char *blockData = NULL;
+
+        if (tmpDirEntry->startBlock == -1)
+        {
+            // The directory entry of a small file never moves, and appends only add bytes after the view
+            blockData = tmpDirEntry->inlineData;
+        }
+        else if (blockPtr != -1 && disk->mappedDisk != NULL)
+        {
+            blockData = getMappedBlock(blockPtr);
+        }
+        else if (blockPtr != -1)
+        {
+            // The slot stays pinned so the span is valid until the view is released
+            struct cacheBlock *entry = getCachedBlock(blockPtr, 1);
+            if (entry != NULL)
+            {
+                viewBlocks[pinnedCount++] = entry;
+                blockData = entry->data;
+            }
+        }
+
+        if (blockData == NULL)
+        {
+            printf("ERROR: Could not map the block in range to a view!\n");
+            for (int j = 0; j < pinnedCount; j++)
+            {
+                releaseCachedBlock(viewBlocks[j]);
+            }
+            releaseViewPins(pinsSlots ? spanCapacity : 0);
+            free(view);
+            free(viewBlocks);
+            return -1;
+        }
+
+        // Spans of physically adjacent mapped blocks are merged
+        if (spanCount > 0 && (char *)view[spanCount - 1].iov_base + view[spanCount - 1].iov_len == blockData + startOffset)
+        {
+            view[spanCount - 1].iov_len += endOffset - startOffset;
+        }
+        else
+        {
+            view[spanCount].iov_base = blockData + startOffset;
+            view[spanCount].iov_len = endOffset - startOffset;
+            spanCount++;
+        }
+    }
+
+    getOpenFile(fd)->view = view;
+    getOpenFile(fd)->viewBlocks = viewBlocks;
+    getOpenFile(fd)->viewBlockCount = pinnedCount;
+    getOpenFile(fd)->positionPtr = logicalEndOffset;
+    __atomic_add_fetch(&(tmpDirEntry->viewCount), 1, __ATOMIC_SEQ_CST);
+
+    *iov = view;
+    *cnt = spanCount;
+    return n;
+}
+
+int createCopiedView(int fd, int n, struct iovec **iov, int *cnt)
+{
+    // One span over a private copy, it stays valid until the view is released like a pinned one
+    struct iovec *view = malloc(sizeof(struct iovec));
+    char *copy = malloc(n);
+    int logicalStartOffset = getOpenFile(fd)->positionPtr;
+    if (view == NULL || copy == NULL || readFromFile(fd, copy, n, logicalStartOffset) != n)
+    {
+        printf("ERROR: Could not copy the range to a view!\n");
+        free(view);
+        free(copy);
+        return -1;
+    }
+
+    view[0].iov_base = copy;
+    view[0].iov_len = n;
+    getOpenFile(fd)->view = view;
+    getOpenFile(fd)->viewCopy = copy;
+    getOpenFile(fd)->positionPtr = logicalStartOffset + n;
+    __atomic_add_fetch(&(getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex)->viewCount), 1, __ATOMIC_SEQ_CST);
+
+    *iov = view;
+    *cnt = 1;
+    return n;
+}
+
+int reserveViewPins(int blockCount)
+{
+    // The rest of the buffer cache stays free for reads and appends, which fail when every slot is pinned
+    pthread_mutex_lock(&disk->cacheLock);
+    if (disk->viewPinnedCount + blockCount > disk->bufferCacheSize / VIEW_PIN_SHARE)
+    {
+        pthread_mutex_unlock(&disk->cacheLock);
+        return -1;
+    }
+    disk->viewPinnedCount += blockCount;
+    pthread_mutex_unlock(&disk->cacheLock);
+    return (0);
+}
+
+void releaseViewPins(int blockCount)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    disk->viewPinnedCount -= blockCount;
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+int appendToFile(int fd, void *buf, int n, struct asyncRequest *request)
+{
+    // Check the correct mode
+    if (getOpenFile(fd)->accessMode == MODE_READ)
+    {
+        printf("ERROR: can't append in READ mode!\n");
+        return -1;
+    }
+
+    // Mount leaves the chain alone, its tail is found on the first append
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    if (tmpDirEntry->lastBlock == -1)
+    {
+        cacheFileTail(getOpenFile(fd)->cachedRootDirIndex);
+    }
+
+    // Appends are held back and get their blocks in one batch when DELAYED_APPEND_BLOCKS are held, on close and on sync.
+    // Asynchronous appends, appends under FLUSH_IMMEDIATE and appends staying inline are written right away.
+    int delayedLimit = DELAYED_APPEND_BLOCKS << disk->blockShift;
+    int staysInline = tmpDirEntry->startBlock == -1 && tmpDirEntry->size + tmpDirEntry->delayedSize + n <= INLINE_DATA_MAX;
+    if (request == NULL && disk->flushPolicy != FLUSH_IMMEDIATE && !staysInline)
+    {
+        if (tmpDirEntry->delayedSize + n > delayedLimit && writeDelayedAppends(fd) == -1)
+        {
+            return -1;
+        }
+        if (n <= delayedLimit)
+        {
+            return delayAppend(fd, buf, n);
+        }
+    }
+
+    // Held bytes go first so the file keeps the order of the appends
+    if (writeDelayedAppends(fd) == -1)
+    {
+        return -1;
+    }
+    return writeToFile(fd, buf, n, request);
+}
+
+int delayAppend(int fd, void *buf, int n)
+{
+    int cacheIndex = getOpenFile(fd)->cachedRootDirIndex;
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    int length = tmpDirEntry->delayedSize + n;
+    if (length > tmpDirEntry->delayedCapacity)
+    {
+        int capacity = (tmpDirEntry->delayedCapacity > 0) ? tmpDirEntry->delayedCapacity : disk->blockSize;
+        while (capacity < length)
+        {
+            capacity *= 2;
+        }
+        char *data = realloc(tmpDirEntry->delayedData, capacity);
+        if (data == NULL)
+        {
+            printf("ERROR: Could not hold the appended data!\n");
+            return -1;
+        }
+        tmpDirEntry->delayedData = data;
+        tmpDirEntry->delayedCapacity = capacity;
+    }
+
+    // Blocks are reserved now, so the append fails here rather than when the data is written
+    long long total = (long long)tmpDirEntry->size + length;
+    int needed = (int)((total + disk->blockSize - 1) >> disk->blockShift) - tmpDirEntry->blockCount - tmpDirEntry->reservedBlocks;
+    if (needed > 0)
+    {
+        pthread_mutex_lock(&disk->allocatorLock);
+        int available = disk->freeBlockCount - disk->pendingFreeCount - disk->reservedBlockCount;
+        if (needed > available)
+        {
+            pthread_mutex_unlock(&disk->allocatorLock);
+            printf("ERROR: Not enough free blocks available! required: %d  free:%d\n", needed, available);
+            return -1;
+        }
+        disk->reservedBlockCount += needed;
+        tmpDirEntry->reservedBlocks += needed;
+        pthread_mutex_unlock(&disk->allocatorLock);
+    }
+
+    memcpy(tmpDirEntry->delayedData + tmpDirEntry->delayedSize, buf, n);
+    __atomic_store_n(&(tmpDirEntry->delayedSize), length, __ATOMIC_RELAXED);
+    return n;
+}
+
+int writeDelayedAppends(int fd)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    if (tmpDirEntry->delayedSize == 0)
+    {
+        return (0);
+    }
+
+    // The held bytes become one append, its blocks are allocated together
+    int length = tmpDirEntry->delayedSize;
+    __atomic_store_n(&(tmpDirEntry->delayedSize), 0, __ATOMIC_RELAXED);
+    int res = writeToFile(fd, tmpDirEntry->delayedData, length, NULL);
+    releaseDelayedAppends(tmpDirEntry, 0);
+    return (res == -1) ? -1 : 0;
+}
+
+void releaseDelayedAppends(struct dirEntry *tmpDirEntry, int freeData)
+{
+    pthread_mutex_lock(&disk->allocatorLock);
+    disk->reservedBlockCount -= tmpDirEntry->reservedBlocks;
+    tmpDirEntry->reservedBlocks = 0;
+    pthread_mutex_unlock(&disk->allocatorLock);
+
+    __atomic_store_n(&(tmpDirEntry->delayedSize), 0, __ATOMIC_RELAXED);
+    if (freeData)
+    {
+        free(tmpDirEntry->delayedData);
+        tmpDirEntry->delayedData = NULL;
+        tmpDirEntry->delayedCapacity = 0;
+    }
+}
+
+int writeToFile(int fd, void *buf, int n, struct asyncRequest *request)
+{
+    // Get cached directory entry of the file
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex);
+    int size = tmpDirEntry->size;
+
+    // Small files grow in the directory entry, readers and flushes only use the bytes before size
+    if (tmpDirEntry->startBlock == -1 && size + n <= INLINE_DATA_MAX)
+    {
+        memcpy(tmpDirEntry->inlineData + size, buf, n);
+        resizeDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex, size + n, -1);
+        return n;
+    }
+
+    // A file outgrowing its entry moves to a block first, its content stays the same if the append then fails
+    if (tmpDirEntry->startBlock == -1 && moveInlineDataToBlock(getOpenFile(fd)->cachedRootDirIndex) == -1)
+    {
+        return -1;
+    }
+
+    // Logical block offset of file for last block
+    int dataBlockOffset = size & (disk->blockSize - 1);
+    if (size > 0 && dataBlockOffset == 0)
+    {
+        dataBlockOffset = disk->blockSize;
+    }
+
+    // Calculate remaining bytes of the last block and required block count for the remaining bytes
+    int remainingByte = disk->blockSize - dataBlockOffset;
+    int requiredBlockCount = 0;
+
+    // Check if the available bytes in the last block is sufficient
+    if (n > remainingByte)
+    {
+        requiredBlockCount = (n - remainingByte + disk->blockSize - 1) >> disk->blockShift;
+    }
+
+    // All new blocks are allocated at once before any data is written,
+    // so an append that does not fit leaves the file untouched
+    int lastBlockOfFile = tmpDirEntry->lastBlock;
+    int oldBlockCount = tmpDirEntry->blockCount;
+    int firstNewBlock = -1;
+    if (requiredBlockCount > 0)
+    {
+        firstNewBlock = allocateBlockRunForFile(getOpenFile(fd)->cachedRootDirIndex, requiredBlockCount);
+
+        if (firstNewBlock == -1)
+        {
+            return -1;
+        }
+    }
+
+    int byteCount = 0;
+    int res = 0;
+
+    // Partial block write, fill the last block of the file first
+    if (remainingByte > 0)
+    {
+        res = writeFromBufferToBlock((char *)buf, lastBlockOfFile, dataBlockOffset, disk->blockSize, &byteCount, n);
+    }
+
+    // Full block writes into the new blocks. Asynchronous appends walk them twice and submit their runs only
+    // after every write through the buffer cache went through, so a failed append can still give its blocks back.
+    int firstFullByte = byteCount;
+    int submitted = 0;
+    for (int pass = (request != NULL) ? 0 : 1; pass < 2 && res != -1; pass++)
+    {
+        byteCount = firstFullByte;
+        int blockPtr = firstNewBlock;
+        while (res != -1 && byteCount != n && blockPtr != -1)
+        {
+            // Full blocks that are also physically adjacent are written with a single call
+            int runLength = 0;
+            while (((n - byteCount) >> disk->blockShift) > runLength && getFatEntry(blockPtr + runLength) == blockPtr + runLength + 1)
+            {
+                runLength++;
+            }
+            if (((n - byteCount) >> disk->blockShift) > runLength)
+            {
+                // The last block of the run
+                runLength++;
+            }
+
+            if (runLength >= VECTORED_IO_MIN_BLOCKS)
+            {
+                // Asynchronous appends leave the run to the backend, the partial last block always goes through the cache
+                if (pass == 1)
+                {
+                    res = (request != NULL) ? submitAsyncOperation(request, (char *)buf + byteCount, blockPtr, runLength, NULL, 0, 0)
+                                            : writeBufferToBlockRun((char *)buf + byteCount, blockPtr, runLength);
+                    submitted += (request != NULL && res != -1);
+                }
+                byteCount += runLength * disk->blockSize;
+                blockPtr = getFatEntry(blockPtr + runLength - 1);
+                continue;
+            }
+
+            if (pass == 0 || request == NULL)
+            {
+                res = writeFromBufferToBlock((char *)buf, blockPtr, 0, disk->blockSize, &byteCount, n);
+            }
+            else
+            {
+                byteCount += (n - byteCount < disk->blockSize) ? n - byteCount : disk->blockSize;
+            }
+            blockPtr = getFatEntry(blockPtr);
+        }
+    }
+
+    // Nothing in flight writes to the new blocks, they are freed and the file keeps its size
+    if ((res == -1 || byteCount != n) && submitted == 0)
+    {
+        if (firstNewBlock != -1)
+        {
+            pthread_mutex_lock(&disk->allocatorLock);
+            releaseNewBlockRuns(tmpDirEntry, firstNewBlock, lastBlockOfFile, oldBlockCount, 0);
+            pthread_mutex_unlock(&disk->allocatorLock);
+        }
+        printf("ERROR: Could not write n bytes!\n");
+        return -1;
+    }
+
+    // Modify file size at directory entry, the block is written with the next metadata flush.
+    // Runs already submitted keep their blocks, the request reports the failure.
+    resizeDirectoryEntry(getOpenFile(fd)->cachedRootDirIndex, tmpDirEntry->size + n, tmpDirEntry->startBlock);
+
+    if (res == -1 || byteCount != n)
+    {
+        printf("ERROR: Could not write n bytes!\n");
+        return -1;
+    }
+
+    return byteCount;
+}
+
+int moveInlineDataToBlock(int cacheIndex)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    int block = allocateBlockRunForFile(cacheIndex, 1);
+    if (block == -1)
+    {
+        return -1;
+    }
+
+    resizeDirectoryEntry(cacheIndex, tmpDirEntry->size, block);
+    int byteCount = 0;
+    if (tmpDirEntry->size > 0 &&
+        writeFromBufferToBlock(tmpDirEntry->inlineData, block, 0, tmpDirEntry->size, &byteCount, tmpDirEntry->size) == -1)
+    {
+        printf("ERROR: Could not move the data of the file to a block!\n");
+        return -1;
+    }
+    return (0);
+}
+
+int deleteFile(char *filename)
+{
+    // Find the directory entry of the file
+    int directoryIndex = findDirectoryEntryIndexByPath(filename);
+    if (directoryIndex == -1)
+    {
+        printf("ERROR: Could not find the file with the given name!\n");
+        return -1;
+    }
+
+    if (getDirectoryEntry(directoryIndex)->type != TYPE_FILE)
+    {
+        printf("ERROR: Use vsrmdir to remove a directory!\n");
+        return -1;
+    }
+
+    // Wait for readers and appenders that are already inside the file
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(directoryIndex);
+    pthread_rwlock_wrlock(&(tmpDirEntry->lock));
+
+    // Blocks of the file may still be referenced by read views
+    if (__atomic_load_n(&(tmpDirEntry->viewCount), __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_rwlock_unlock(&(tmpDirEntry->lock));
+        printf("ERROR: File has outstanding read views!\n");
+        return -1;
+    }
+    if (__atomic_load_n(&(tmpDirEntry->asyncCount), __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_rwlock_unlock(&(tmpDirEntry->lock));
+        printf("ERROR: File has outstanding asynchronous requests!\n");
+        return -1;
+    }
+
+    // The rest of the delete is collected into one journal transaction
+    pthread_rwlock_rdlock(&disk->transactionLock);
+
+    // Close every descriptor of the file
+    while (tmpDirEntry->openDescriptor != -1)
+    {
+        closeFile(tmpDirEntry->openDescriptor);
+    }
+
+    // Deallocate root directory of file on disk
+    deallocateDirectoryEntry(directoryIndex);
+    disk->freeDirectorySlots[disk->freeDirectorySlotCount++] = directoryIndex;
+
+    // Bytes held for delayed allocation never get their blocks
+    releaseDelayedAppends(tmpDirEntry, 1);
+
+    // Deallocate all FAT entries of the file, a file with inline data has none
+    if (tmpDirEntry->startBlock != -1)
+    {
+        deallocateFatEntriesOfFile(tmpDirEntry->startBlock);
+    }
+    tmpDirEntry->lastBlock = -1;
+    tmpDirEntry->blockCount = 0;
+    releaseSkipIndex(tmpDirEntry);
+
+    // Decrease file count
+    __atomic_sub_fetch(&disk->fileCount, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&disk->transactionLock);
+    pthread_rwlock_unlock(&(tmpDirEntry->lock));
+    return (0);
+}
+
+int removeDirectory(char *dirname)
+{
+    int directoryIndex = findDirectoryEntryIndexByPath(dirname);
+    if (directoryIndex == -1)
+    {
+        printf("ERROR: Could not find the directory with the given name!\n");
+        return -1;
+    }
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(directoryIndex);
+    if (tmpDirEntry->type != TYPE_DIRECTORY)
+    {
+        printf("ERROR: Not a directory!\n");
+        return -1;
+    }
+    if (tmpDirEntry->firstChild != -1)
+    {
+        printf("ERROR: Directory is not empty!\n");
+        return -1;
+    }
+
+    // A directory owns no blocks, only its entry is released
+    deallocateDirectoryEntry(directoryIndex);
+    disk->freeDirectorySlots[disk->freeDirectorySlotCount++] = directoryIndex;
+    __atomic_sub_fetch(&disk->fileCount, 1, __ATOMIC_RELAXED);
+    return (0);
+}
+
+int readDirectory(char *dirname, struct vsDirent *entries, int maxEntries)
+{
+    int directoryIndex = ROOT_DIRECTORY_INDEX;
+    if (!isRootPath(dirname))
+    {
+        directoryIndex = findDirectoryEntryIndexByPath(dirname);
+        if (directoryIndex == -1)
+        {
+            printf("ERROR: Could not find the directory with the given name!\n");
+            return -1;
+        }
+        if (getDirectoryEntry(directoryIndex)->type != TYPE_DIRECTORY)
+        {
+            printf("ERROR: Not a directory!\n");
+            return -1;
+        }
+    }
+
+    // Walk the entries of the directory only, sizes change under the directory lock
+    int count = 0;
+    pthread_mutex_lock(&disk->directoryLock);
+    int i = (directoryIndex == ROOT_DIRECTORY_INDEX) ? disk->rootFirstChild : getDirectoryEntry(directoryIndex)->firstChild;
+    while (i != -1)
+    {
+        struct dirEntry *tmpDirEntry = getDirectoryEntry(i);
+        if (count < maxEntries)
+        {
+            memcpy(entries[count].name, tmpDirEntry->filename, MAX_FILENAME_LENGTH);
+            entries[count].name[MAX_FILENAME_LENGTH] = '\0';
+            entries[count].type = tmpDirEntry->type;
+            // Held bytes change under the file lock only, a file being written may be listed a little short
+            entries[count].size = tmpDirEntry->size + __atomic_load_n(&(tmpDirEntry->delayedSize), __ATOMIC_RELAXED);
+        }
+        count++;
+        i = tmpDirEntry->nextSibling;
+    }
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    // Number of entries in the directory, may be more than maxEntries
+    return count;
+}
+
+int vssync()
+{
+    flushAllDelayedAppends();
+    if (flushMetadata() == -1)
+    {
+        return -1;
+    }
+
+    fsync(disk->vs_fd);
+    return (0);
+}
+
+int vssetcachesize(int blockCount)
+{
+    if (blockCount < 1)
+    {
+        printf("ERROR: Buffer cache needs at least one block!\n");
+        return -1;
+    }
+
+    // Takes effect on the next vsmount
+    disk->bufferCacheSize = blockCount;
+    return (0);
+}
+
+void vsgetcachestats(struct vsCacheStats *stats)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    *stats = disk->cacheStats;
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+int vsgetblocksize()
+{
+    // Block size of the mounted disk, or of the last one formatted
+    return disk->blockSize;
+}
+
+void vsgetiostats(struct vsIoStats *stats)
+{
+    *stats = disk->ioStats;
+}
+
+void vsresetstats()
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    memset(&disk->cacheStats, 0, sizeof(disk->cacheStats));
+    memset(&disk->ioStats, 0, sizeof(disk->ioStats));
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+int vssetflushpolicy(int policy, int intervalMs)
+{
+    if (policy < FLUSH_IMMEDIATE || policy > FLUSH_ON_SYNC)
+    {
+        printf("ERROR: Unknown flush policy! %d\n", policy);
+        return -1;
+    }
+    if (policy == FLUSH_PERIODIC && intervalMs < 1)
+    {
+        printf("ERROR: Flush interval needs at least one millisecond!\n");
+        return -1;
+    }
+
+    // Switching policy writes back what the old one was holding
+    stopFlushThread();
+    if (disk->diskMounted)
+    {
+        flushMetadata();
+    }
+
+    disk->flushPolicy = policy;
+    if (policy == FLUSH_PERIODIC)
+    {
+        disk->flushInterval = intervalMs;
+        if (disk->diskMounted)
+        {
+            startFlushThread();
+        }
+    }
+    return (0);
+}
+
+int vssetallocationwindow(int blockCount)
+{
+    if (blockCount < 1)
+    {
+        printf("ERROR: Allocation window needs at least one block!\n");
+        return -1;
+    }
+
+    disk->allocationWindow = blockCount;
+    return (0);
+}
+
+void vsfragreport()
+{
+    int totalExtents = 0;
+    int totalBlocks = 0;
+
+    pthread_mutex_lock(&disk->namespaceLock);
+    pthread_mutex_lock(&disk->allocatorLock);
+    printf("%-30s %8s %8s %10s\n", "file", "blocks", "extents", "avg extent");
+    for (int i = 0; i < disk->directoryEntryCount; i++)
+    {
+        struct dirEntry *tmpDirEntry = getDirectoryEntry(i);
+        if (tmpDirEntry->allocated != USED_FLAG || tmpDirEntry->startBlock == -1)
+        {
+            continue;
+        }
+
+        // Every break in physical adjacency along the chain starts a new extent
+        int extents = 1;
+        int blocks = 1;
+        int traverseBlock = tmpDirEntry->startBlock;
+        while (getFatEntry(traverseBlock) != EOF_FLAG)
+        {
+            if (getFatEntry(traverseBlock) != traverseBlock + 1)
+            {
+                extents++;
+            }
+            traverseBlock = getFatEntry(traverseBlock);
+            blocks++;
+        }
+
+        printf("%-30.30s %8d %8d %10.2f\n", tmpDirEntry->filename, blocks, extents, (double)blocks / extents);
+        totalExtents += extents;
+        totalBlocks += blocks;
+    }
+
+    if (totalExtents > 0)
+    {
+        printf("average extent length: %.2f blocks\n", (double)totalBlocks / totalExtents);
+    }
+    pthread_mutex_unlock(&disk->allocatorLock);
+    pthread_mutex_unlock(&disk->namespaceLock);
+}
+
+// Virtual Disk & Cache Functions
+
+int getSuperblock()
+{
+    // The fields come first, so the smallest block holds them whatever the block size is
+    char header[MIN_BLOCK_SIZE];
+    setBlockSize(MIN_BLOCK_SIZE);
+    if (read_block((void *)header, SUPERBLOCK_START) == -1)
+    {
+        return -1;
+    }
+
+    // Disks formatted before the journal have no magic number
+    if (((int *)(header + 16))[0] != VSFS_MAGIC || ((int *)(header + 20))[0] != VSFS_VERSION)
+    {
+        printf("ERROR: The virtual disk is not formatted for this version, format it again!\n");
+        return -1;
+    }
+    if (setBlockSize(((int *)(header + 40))[0]) == -1)
+    {
+        printf("ERROR: The superblock block size is not valid!\n");
+        return -1;
+    }
+
+    char block[disk->blockSize];
+    if (read_block((void *)block, SUPERBLOCK_START) == -1)
+    {
+        return -1;
+    }
+
+    disk->dataBlockCount = ((int *)(block))[0];
+    disk->totalBlockCount = ((int *)(block + 4))[0];
+    disk->journaledFreeBlockCount = ((int *)(block + 8))[0];
+    disk->journaledFileCount = ((int *)(block + 12))[0];
+    disk->journalSequence = ((int *)(block + 32))[0];
+
+    // The rest of the layout follows from the FAT size
+    setDiskLayout(((int *)(block + 36))[0]);
+    if (((int *)(block + 24))[0] != disk->journalStart || ((int *)(block + 28))[0] != disk->journalBlockCount ||
+        disk->fatBlockCount < 1 || (long long)disk->fatBlockCount * disk->fatEntriesPerBlock < disk->totalBlockCount ||
+        disk->totalBlockCount <= disk->metadataBlockCount || disk->dataBlockCount != disk->totalBlockCount - disk->metadataBlockCount)
+    {
+        printf("ERROR: The superblock layout is not valid!\n");
+        return -1;
+    }
+    memcpy(disk->freeSummary, block + FREE_SUMMARY_OFFSET, (size_t)disk->freeSummaryRegions * sizeof(int));
+    return (0);
+}
+
+int setSuperblock()
+{
+    char block[disk->blockSize];
+    memset(block, 0, disk->blockSize);
+    ((int *)(block))[0] = disk->dataBlockCount;
+    ((int *)(block + 4))[0] = disk->totalBlockCount;
+    ((int *)(block + 8))[0] = disk->journaledFreeBlockCount;
+    ((int *)(block + 12))[0] = disk->journaledFileCount;
+    ((int *)(block + 16))[0] = VSFS_MAGIC;
+    ((int *)(block + 20))[0] = VSFS_VERSION;
+    ((int *)(block + 24))[0] = disk->journalStart;
+    ((int *)(block + 28))[0] = disk->journalBlockCount;
+    ((int *)(block + 32))[0] = disk->journalSequence; // First transaction expected at the journal start
+    ((int *)(block + 36))[0] = disk->fatBlockCount;
+    ((int *)(block + 40))[0] = disk->blockSize;
+
+    // Regions with every page loaded are counted again, so a stale hint does not outlive a full load
+    pthread_mutex_lock(&disk->allocatorLock);
+    for (int i = 0; i < disk->freeSummaryRegions && i * disk->summaryRegionPages < disk->fatBlockCount; i++)
+    {
+        if (__atomic_load_n(&disk->regionLoadedPages[i], __ATOMIC_RELAXED) == getRegionPageCount(i))
+        {
+            disk->freeSummary[i] = countRegionFreeBlocks(i);
+        }
+    }
+    memcpy(block + FREE_SUMMARY_OFFSET, disk->freeSummary, (size_t)disk->freeSummaryRegions * sizeof(int));
+    pthread_mutex_unlock(&disk->allocatorLock);
+    return write_block((void *)block, SUPERBLOCK_START);
+}
+
+int setBlockSize(int size)
+{
+    if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE || (size & (size - 1)) != 0)
+    {
+        return -1;
+    }
+
+    // Everything sized in blocks follows, divisions by these are shifts
+    disk->blockSize = size;
+    disk->blockShift = __builtin_ctz(size);
+    disk->fatEntriesPerBlock = size / FAT_ENTRY_SIZE;
+    disk->fatEntryShift = __builtin_ctz(disk->fatEntriesPerBlock);
+    disk->dirEntriesPerBlock = size / DIR_ENTRY_SIZE;
+    disk->bitmapWordCount = disk->fatEntriesPerBlock / BITMAP_WORD_BITS;
+    disk->freeSummaryRegions = (size - FREE_SUMMARY_OFFSET) / (int)sizeof(int);
+    disk->freeSummaryRegions = (disk->freeSummaryRegions < FREE_SUMMARY_REGIONS) ? disk->freeSummaryRegions : FREE_SUMMARY_REGIONS;
+    disk->directoryBlockLimit = DIR_ENTRY_MAX / disk->dirEntriesPerBlock;
+    return (0);
+}
+
+void setDiskLayout(int fatBlocks)
+{
+    // The journal holds a transaction that changes every FAT block, besides its fixed part
+    disk->fatBlockCount = fatBlocks;
+    disk->rootDirStart = FAT_BLOCK_START + disk->fatBlockCount;
+    disk->journalStart = disk->rootDirStart + ROOT_DIR_COUNT;
+    disk->journalBlockCount = (JOURNAL_FIXED_SIZE >> disk->blockShift) + (int)(((long long)disk->fatBlockCount * FAT_RECORD_MAX + disk->blockSize - 1) >> disk->blockShift);
+    disk->metadataBlockCount = disk->journalStart + disk->journalBlockCount;
+    disk->summaryRegionPages = (disk->fatBlockCount + disk->freeSummaryRegions - 1) / disk->freeSummaryRegions;
+}
+
+void initializeSuperBlock(int blockCount, char *block)
+{
+    memset(block, 0, disk->blockSize);
+    ((int *)(block))[0] = blockCount - disk->metadataBlockCount;     // total data block count
+    ((int *)(block + 4))[0] = blockCount;                      // total block count
+    ((int *)(block + 8))[0] = blockCount - disk->metadataBlockCount; // free blocks
+    ((int *)(block + 12))[0] = 0;                              // number of files
+    ((int *)(block + 16))[0] = VSFS_MAGIC;
+    ((int *)(block + 20))[0] = VSFS_VERSION;
+    ((int *)(block + 24))[0] = disk->journalStart;
+    ((int *)(block + 28))[0] = disk->journalBlockCount;
+    ((int *)(block + 32))[0] = 1; // journal sequence, the zeroed journal holds no transaction
+    ((int *)(block + 36))[0] = disk->fatBlockCount;
+    ((int *)(block + 40))[0] = disk->blockSize;
+
+    // Every data block of a region starts free
+    for (int i = 0; i < disk->freeSummaryRegions && i * disk->summaryRegionPages < disk->fatBlockCount; i++)
+    {
+        int first = i * disk->summaryRegionPages * disk->fatEntriesPerBlock;
+        int last = (i + 1) * disk->summaryRegionPages * disk->fatEntriesPerBlock;
+        first = (first > disk->metadataBlockCount) ? first : disk->metadataBlockCount;
+        last = (last < blockCount) ? last : blockCount;
+        ((int *)(block + FREE_SUMMARY_OFFSET))[i] = (last > first) ? last - first : 0;
+    }
+}
+
+int initializeFatBlock(int fatBlock, int diskBlockCount, char *block)
+{
+    int firstEntry = fatBlock * disk->fatEntriesPerBlock;
+    if (firstEntry >= disk->metadataBlockCount && firstEntry + disk->fatEntriesPerBlock <= diskBlockCount)
+    {
+        // Only free data blocks, the block stays zero
+        memset(block, 0, disk->blockSize);
+        return (0);
+    }
+
+    for (int j = 0; j < disk->fatEntriesPerBlock; j++)
+    {
+        int entry = firstEntry + j;
+        if (entry >= diskBlockCount)
+        {
+            // Mark unavailable block numbers inaccessible
+            ((int *)(block + j * FAT_ENTRY_SIZE))[0] = EOF_FLAG;
+        }
+        else if (entry >= disk->rootDirStart && entry < disk->rootDirStart + ROOT_DIR_COUNT - 1)
+        {
+            // The initial directory blocks start the directory chain
+            ((int *)(block + j * FAT_ENTRY_SIZE))[0] = entry + 1;
+        }
+        else if (entry < disk->metadataBlockCount)
+        {
+            // Mark meta data blocks as allocated
+            ((int *)(block + j * FAT_ENTRY_SIZE))[0] = EOF_FLAG;
+        }
+        else
+        {
+            ((int *)(block + j * FAT_ENTRY_SIZE))[0] = NOT_USED_FLAG;
+        }
+    }
+    return (1);
+}
+
+int initializeMetadataBlocks(int diskBlockCount)
+{
+    int runBlocks = FORMAT_WRITE_SIZE >> disk->blockShift;
+    char *buffer = malloc(FORMAT_WRITE_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    // Superblock and FAT go out in runs, runs of all free entries are left to the zeroed file.
+    // The directory blocks hold unused entries only, which are zero as well.
+    for (int first = SUPERBLOCK_START; first < disk->rootDirStart; first += runBlocks)
+    {
+        int runLength = (disk->rootDirStart - first < runBlocks) ? disk->rootDirStart - first : runBlocks;
+        int used = 0;
+        for (int i = 0; i < runLength; i++)
+        {
+            char *block = buffer + (size_t)i * disk->blockSize;
+            if (first + i == SUPERBLOCK_START)
+            {
+                initializeSuperBlock(diskBlockCount, block);
+                used = 1;
+            }
+            else
+            {
+                used |= initializeFatBlock(first + i - FAT_BLOCK_START, diskBlockCount, block);
+            }
+        }
+
+        if (used && write_block_run(buffer, first, runLength) == -1)
+        {
+            free(buffer);
+            return -1;
+        }
+    }
+
+    free(buffer);
+    return (0);
+}
+
+void cacheFatTable()
+{
+    // Pages loaded for recovery take the replayed entries, the others load from their home blocks when used
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        if (disk->fatPages[i] != NULL)
+        {
+            memcpy(disk->fatPages[i]->entries, disk->fatPages[i]->journaled, disk->blockSize);
+            buildFreeBlockBits(disk->fatPages[i]);
+        }
+    }
+}
+
+int cacheRootDirectory()
+{
+    disk->directoryEntryCount = 0;
+    disk->directoryBlockCount = 0;
+    disk->freeDirectorySlotCount = 0;
+    for (int i = 0; i < disk->journaledDirectoryBlockCount; i++)
+    {
+        if (addDirectoryBlock(disk->journaledDirectoryBlocks[i]) == -1)
+        {
+            return -1;
+        }
+    }
+
+    for (int i = disk->directoryEntryCount - 1; i >= 0; i--)
+    {
+        struct dirEntry *tmpDirEntry = getDirectoryEntry(i);
+        char *entry = disk->journaledRootDirectory + i * DIR_ENTRY_SIZE;
+        memcpy(tmpDirEntry->filename, entry, MAX_FILENAME_LENGTH);
+
+        // The fields follow the name at offsets that are not multiples of four, they are copied rather than loaded
+        memcpy(&(tmpDirEntry->size), entry + MAX_FILENAME_LENGTH, sizeof(int));
+        memcpy(&(tmpDirEntry->startBlock), entry + MAX_FILENAME_LENGTH + 4, sizeof(int));
+        memcpy(&(tmpDirEntry->allocated), entry + MAX_FILENAME_LENGTH + 8, sizeof(int));
+        memcpy(&(tmpDirEntry->parent), entry + MAX_FILENAME_LENGTH + 12, sizeof(int));
+        memcpy(&(tmpDirEntry->type), entry + MAX_FILENAME_LENGTH + 16, sizeof(int));
+        memcpy(tmpDirEntry->inlineData, entry + INLINE_DATA_OFFSET, INLINE_DATA_MAX);
+        if (tmpDirEntry->allocated == USED_FLAG && tmpDirEntry->parent != ROOT_DIRECTORY_INDEX &&
+            (tmpDirEntry->parent < 0 || tmpDirEntry->parent >= disk->directoryEntryCount))
+        {
+            printf("WARNING: Entry %d has no valid parent, moving it to the root directory!\n", i);
+            tmpDirEntry->parent = ROOT_DIRECTORY_INDEX;
+        }
+
+        // Lowest unused entries are handed out first
+        if (tmpDirEntry->allocated != USED_FLAG)
+        {
+            disk->freeDirectorySlots[disk->freeDirectorySlotCount++] = i;
+        }
+    }
+    return (0);
+}
+
+int addDirectoryBlock(int block)
+{
+    int firstEntry = disk->directoryBlockCount * disk->dirEntriesPerBlock;
+    int chunk = firstEntry / DIR_CHUNK_ENTRIES;
+
+    // Memory is prepared first, nothing is published if it fails
+    if (disk->cachedRootDirectory[chunk] == NULL)
+    {
+        disk->cachedRootDirectory[chunk] = calloc(DIR_CHUNK_ENTRIES, sizeof(struct dirEntry));
+        if (disk->cachedRootDirectory[chunk] == NULL)
+        {
+            return -1;
+        }
+        for (int i = 0; i < DIR_CHUNK_ENTRIES; i++)
+        {
+            pthread_rwlock_init(&(disk->cachedRootDirectory[chunk][i].lock), NULL);
+            pthread_mutex_init(&(disk->cachedRootDirectory[chunk][i].indexLock), NULL);
+        }
+    }
+    int *slots = realloc(disk->freeDirectorySlots, (size_t)(firstEntry + disk->dirEntriesPerBlock) * sizeof(int));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+    disk->freeDirectorySlots = slots;
+
+    for (int i = firstEntry; i < firstEntry + disk->dirEntriesPerBlock; i++)
+    {
+        struct dirEntry *tmpDirEntry = getDirectoryEntry(i);
+        memset(tmpDirEntry->filename, 0, MAX_FILENAME_LENGTH);
+        tmpDirEntry->size = 0;
+        tmpDirEntry->startBlock = 0;
+        tmpDirEntry->allocated = NOT_USED_FLAG;
+        tmpDirEntry->parent = 0;
+        tmpDirEntry->type = TYPE_FILE;
+        tmpDirEntry->lastBlock = -1;
+        tmpDirEntry->blockCount = 0;
+        tmpDirEntry->viewCount = 0;
+        tmpDirEntry->openDescriptor = -1;
+        tmpDirEntry->hashNext = -1;
+        tmpDirEntry->firstChild = -1;
+        tmpDirEntry->nextSibling = -1;
+        tmpDirEntry->prevSibling = -1;
+        tmpDirEntry->skipIndex = NULL;
+        tmpDirEntry->skipIndexCount = 0;
+        tmpDirEntry->skipIndexCapacity = 0;
+        tmpDirEntry->asyncCount = 0;
+        tmpDirEntry->asyncWriteCount = 0;
+        tmpDirEntry->delayedData = NULL;
+        tmpDirEntry->delayedSize = 0;
+        tmpDirEntry->delayedCapacity = 0;
+        tmpDirEntry->reservedBlocks = 0;
+    }
+
+    pthread_mutex_lock(&disk->directoryLock);
+    disk->directoryBlockCount++;
+    disk->directoryEntryCount += disk->dirEntriesPerBlock;
+    disk->directoryLastBlock = block;
+    pthread_mutex_unlock(&disk->directoryLock);
+    return (0);
+}
+
+int growDirectory()
+{
+    if (disk->directoryBlockCount == disk->directoryBlockLimit)
+    {
+        return -1;
+    }
+
+    // The new block is linked after the tail of the directory chain
+    pthread_mutex_lock(&disk->allocatorLock);
+    int runLength;
+    int block = -1;
+    if (disk->freeBlockCount - disk->pendingFreeCount - disk->reservedBlockCount > 0)
+    {
+        block = findAvailableBlockRun(disk->directoryLastBlock + 1, 1, &runLength);
+    }
+    if (block != -1)
+    {
+        allocateBlockFatEntry(block, EOF_FLAG);
+        allocateBlockFatEntry(disk->directoryLastBlock, block);
+        disk->freeBlockCount--;
+    }
+    pthread_mutex_unlock(&disk->allocatorLock);
+
+    if (block == -1)
+    {
+        return -1;
+    }
+
+    // The home block is cleared before any committed FAT can link it, so recovery never reads stale entries
+    char emptyBlock[disk->blockSize];
+    memset(emptyBlock, 0, disk->blockSize);
+    if (write_block((void *)emptyBlock, block) == -1 || addDirectoryBlock(block) == -1)
+    {
+        // Give the block back, the directory chain ends where it did before
+        pthread_mutex_lock(&disk->allocatorLock);
+        allocateBlockFatEntry(disk->directoryLastBlock, EOF_FLAG);
+        allocateBlockFatEntry(block, NOT_USED_FLAG);
+        disk->freeBlockCount++;
+        pthread_mutex_unlock(&disk->allocatorLock);
+        return -1;
+    }
+
+    // Unused entries of the new block are all zero, like the empty block in the journaled copy
+    for (int i = disk->directoryEntryCount - 1; i >= disk->directoryEntryCount - disk->dirEntriesPerBlock; i--)
+    {
+        disk->freeDirectorySlots[disk->freeDirectorySlotCount++] = i;
+    }
+    return (0);
+}
+
+void destroyDirectory()
+{
+    for (int i = 0; i < DIR_CHUNK_COUNT; i++)
+    {
+        if (disk->cachedRootDirectory[i] == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < DIR_CHUNK_ENTRIES; j++)
+        {
+            free(disk->cachedRootDirectory[i][j].skipIndex);
+            free(disk->cachedRootDirectory[i][j].delayedData);
+            pthread_rwlock_destroy(&(disk->cachedRootDirectory[i][j].lock));
+            pthread_mutex_destroy(&(disk->cachedRootDirectory[i][j].indexLock));
+        }
+        free(disk->cachedRootDirectory[i]);
+        disk->cachedRootDirectory[i] = NULL;
+    }
+
+    free(disk->freeDirectorySlots);
+    free(disk->filenameHash);
+    free(disk->journaledRootDirectory);
+    disk->journaledDirectoryCapacity = 0;
+    disk->freeDirectorySlots = NULL;
+    disk->filenameHash = NULL;
+    disk->journaledRootDirectory = NULL;
+    disk->directoryEntryCount = 0;
+    disk->directoryBlockCount = 0;
+    disk->freeDirectorySlotCount = 0;
+}
+
+void cacheFileTail(int cacheIndex)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    tmpDirEntry->lastBlock = -1;
+    tmpDirEntry->blockCount = 0;
+
+    if (tmpDirEntry->allocated != USED_FLAG || tmpDirEntry->startBlock == -1)
+    {
+        return;
+    }
+
+    int traverseBlock = tmpDirEntry->startBlock;
+    tmpDirEntry->blockCount = 1;
+    while (getFatEntry(traverseBlock) != EOF_FLAG)
+    {
+        traverseBlock = getFatEntry(traverseBlock);
+        tmpDirEntry->blockCount++;
+    }
+    tmpDirEntry->lastBlock = traverseBlock;
+}
+
+int flushDirtyMetadataBlocks(char *dirtyBits, int blockCount, int firstBlock, int *homeBlocks, void (*fillBlock)(int, char *))
+{
+    char *buffer = NULL;
+    int written = 0;
+    int i = 0;
+
+    while (i < blockCount)
+    {
+        if (!dirtyBits[i])
+        {
+            i++;
+            continue;
+        }
+
+        // Dirty blocks that are adjacent on the disk go out with a single write
+        int home = (homeBlocks != NULL) ? homeBlocks[i] : firstBlock + i;
+        int runLength = 1;
+        while (i + runLength < blockCount && runLength < WRITEBACK_VECTOR_MAX && dirtyBits[i + runLength] &&
+               ((homeBlocks != NULL) ? homeBlocks[i + runLength] : firstBlock + i + runLength) == home + runLength)
+        {
+            runLength++;
+        }
+
+        if (buffer == NULL)
+        {
+            buffer = malloc((size_t)WRITEBACK_VECTOR_MAX * disk->blockSize);
+            if (buffer == NULL)
+            {
+                return -1;
+            }
+        }
+        for (int j = 0; j < runLength; j++)
+        {
+            fillBlock(i + j, buffer + (size_t)j * disk->blockSize);
+        }
+        if (write_block_run(buffer, home, runLength) == -1)
+        {
+            free(buffer);
+            return -1;
+        }
+
+        memset(dirtyBits + i, 0, runLength);
+        written += runLength;
+        i += runLength;
+    }
+
+    free(buffer);
+    return written;
+}
+
+int flushMetadata()
+{
+    pthread_mutex_lock(&disk->metadataFlushLock);
+
+    // Appends, creates and deletes in progress finish first, so a transaction never holds half of one.
+    // Data blocks are written back and synced before the commit that points at them, the disk may
+    // reorder writes between two syncs and a commit that outlives its data would replay garbage.
+    pthread_rwlock_wrlock(&disk->transactionLock);
+    waitForAsyncWrites(NULL);
+    int recordBytes = -1;
+    if (flushDirtyData() != -1)
+    {
+        recordBytes = collectJournalRecords();
+    }
+    pthread_rwlock_unlock(&disk->transactionLock);
+
+    int res = recordBytes;
+    if (recordBytes > 0)
+    {
+        res = (syncVirtualDisk() == -1) ? -1 : commitJournalTransaction(recordBytes);
+    }
+    if (recordBytes > 0)
+    {
+        releaseCommittedBlocks(res == 0);
+    }
+    if (res == -1 && recordBytes > 0)
+    {
+        // Compare everything against the journal again on the next flush
+        pthread_mutex_lock(&disk->directoryLock);
+        memset(disk->rootDirBlockDirty, 1, disk->directoryBlockCount);
+        disk->rootDirBlockDirtyCount = disk->directoryBlockCount;
+        pthread_mutex_unlock(&disk->directoryLock);
+        pthread_mutex_lock(&disk->allocatorLock);
+        for (int i = 0; i < disk->fatBlockCount; i++)
+        {
+            disk->fatBlockDirty[i] = (__atomic_load_n(&disk->fatPages[i], __ATOMIC_ACQUIRE) != NULL);
+        }
+        pthread_mutex_unlock(&disk->allocatorLock);
+    }
+    pthread_mutex_unlock(&disk->metadataFlushLock);
+
+    if (res == -1)
+    {
+        printf("ERROR: Could not commit the metadata journal!\n");
+        return -1;
+    }
+    return (0);
+}
+
+void releaseCommittedBlocks(int committed)
+{
+    pthread_mutex_lock(&disk->allocatorLock);
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        // Blocks are only freed in loaded pages
+        struct fatPage *page = __atomic_load_n(&disk->fatPages[i], __ATOMIC_ACQUIRE);
+        for (int j = 0; page != NULL && j < disk->bitmapWordCount; j++)
+        {
+            if (page->committingFreeBits[j] == 0)
+            {
+                continue;
+            }
+
+            // Freed blocks become allocatable, or wait for the next commit if this one failed
+            if (committed)
+            {
+                int count = __builtin_popcountll(page->committingFreeBits[j]);
+                page->freeBits[j] |= page->committingFreeBits[j];
+                disk->pendingFreeCount -= count;
+                updateFreeSummary(i * disk->fatEntriesPerBlock, count);
+            }
+            else
+            {
+                page->pendingFreeBits[j] |= page->committingFreeBits[j];
+            }
+            page->committingFreeBits[j] = 0;
+        }
+    }
+    pthread_mutex_unlock(&disk->allocatorLock);
+}
+
+void serializeDirectoryEntry(int cacheIndex, char *entry)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    memset(entry, 0, DIR_ENTRY_SIZE);
+    memcpy(entry, tmpDirEntry->filename, MAX_FILENAME_LENGTH);
+
+    // Unaligned fields after the name, see cacheRootDirectory
+    memcpy(entry + MAX_FILENAME_LENGTH, &(tmpDirEntry->size), sizeof(int));
+    memcpy(entry + MAX_FILENAME_LENGTH + 4, &(tmpDirEntry->startBlock), sizeof(int));
+    memcpy(entry + MAX_FILENAME_LENGTH + 8, &(tmpDirEntry->allocated), sizeof(int));
+    memcpy(entry + MAX_FILENAME_LENGTH + 12, &(tmpDirEntry->parent), sizeof(int));
+    memcpy(entry + MAX_FILENAME_LENGTH + 16, &(tmpDirEntry->type), sizeof(int));
+
+    // Only the bytes of the file, so entries compare equal when their data does
+    if (tmpDirEntry->type == TYPE_FILE && tmpDirEntry->startBlock == -1 && tmpDirEntry->size <= INLINE_DATA_MAX)
+    {
+        memcpy(entry + INLINE_DATA_OFFSET, tmpDirEntry->inlineData, tmpDirEntry->size);
+    }
+}
+
+int collectJournalRecords()
+{
+    int length = 0;
+
+    pthread_mutex_lock(&disk->allocatorLock);
+    int dirtyFatBlocks = 0;
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        dirtyFatBlocks += disk->fatBlockDirty[i];
+    }
+
+    // Every dirty FAT block fits, the rest of the transaction stays within the fixed part of the journal.
+    // The transaction is written in whole blocks, so the buffer is as well.
+    size_t size = JOURNAL_HEADER_SIZE + (size_t)dirtyFatBlocks * FAT_RECORD_MAX + JOURNAL_FIXED_SIZE;
+    if (reserveJournalBuffer((size + disk->blockSize - 1) & ~((size_t)disk->blockSize - 1)) == -1)
+    {
+        pthread_mutex_unlock(&disk->allocatorLock);
+        return -1;
+    }
+    char *records = disk->journalBuffer + JOURNAL_HEADER_SIZE;
+
+    // One record per dirty FAT block, covering the entries that differ from the journal
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        if (!disk->fatBlockDirty[i])
+        {
+            continue;
+        }
+        disk->fatBlockDirty[i] = 0;
+
+        // Only loaded pages are ever changed
+        struct fatPage *page = getFatPage(i);
+        int first = -1;
+        int last = -1;
+        for (int j = 0; page != NULL && j < disk->fatEntriesPerBlock; j++)
+        {
+            if (page->entries[j] != page->journaled[j])
+            {
+                first = (first == -1) ? j : first;
+                last = j;
+            }
+        }
+        if (first == -1)
+        {
+            continue;
+        }
+
+        int *record = (int *)(records + length);
+        record[0] = JOURNAL_RECORD_FAT;
+        record[1] = i * disk->fatEntriesPerBlock + first;
+        record[2] = last - first + 1;
+        memcpy(record + 3, page->entries + first, (size_t)(last - first + 1) * FAT_ENTRY_SIZE);
+        length += (3 + last - first + 1) * FAT_ENTRY_SIZE;
+    }
+    int freeBlocks = disk->freeBlockCount;
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        struct fatPage *page = __atomic_load_n(&disk->fatPages[i], __ATOMIC_ACQUIRE);
+        if (page != NULL)
+        {
+            memcpy(page->committingFreeBits, page->pendingFreeBits, (size_t)disk->bitmapWordCount * sizeof(unsigned long long));
+            memset(page->pendingFreeBits, 0, (size_t)disk->bitmapWordCount * sizeof(unsigned long long));
+        }
+    }
+    pthread_mutex_unlock(&disk->allocatorLock);
+
+    // One record per changed directory entry, blocks that do not fit stay dirty for the next transaction
+    int limit = length + JOURNAL_FIXED_SIZE - JOURNAL_HEADER_SIZE - disk->dirEntriesPerBlock * (8 + DIR_ENTRY_SIZE) - 12;
+    pthread_mutex_lock(&disk->directoryLock);
+    for (int i = 0; i < disk->directoryBlockCount && length <= limit; i++)
+    {
+        if (!disk->rootDirBlockDirty[i])
+        {
+            continue;
+        }
+        disk->rootDirBlockDirty[i] = 0;
+        disk->rootDirBlockDirtyCount--;
+
+        for (int j = i * disk->dirEntriesPerBlock; j < (i + 1) * disk->dirEntriesPerBlock; j++)
+        {
+            int *record = (int *)(records + length);
+            char *committed = (i < disk->journaledDirectoryCapacity) ? disk->journaledRootDirectory + j * DIR_ENTRY_SIZE : disk->emptyDirectoryEntry;
+            serializeDirectoryEntry(j, (char *)(record + 2));
+            if (memcmp(record + 2, committed, DIR_ENTRY_SIZE) != 0)
+            {
+                record[0] = JOURNAL_RECORD_DIR;
+                record[1] = j;
+                length += 8 + DIR_ENTRY_SIZE;
+            }
+        }
+    }
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    int files = __atomic_load_n(&disk->fileCount, __ATOMIC_RELAXED);
+    if (freeBlocks != disk->journaledFreeBlockCount || files != disk->journaledFileCount)
+    {
+        int *record = (int *)(records + length);
+        record[0] = JOURNAL_RECORD_SUPER;
+        record[1] = freeBlocks;
+        record[2] = files;
+        length += 12;
+    }
+
+    return length;
+}
+
+int applyJournalRecords(char *records, int length)
+{
+    int offset = 0;
+    while (offset < length)
+    {
+        int *record = (int *)(records + offset);
+        if (record[0] == JOURNAL_RECORD_FAT && record[1] >= 0 && record[2] > 0 && record[2] <= disk->fatEntriesPerBlock &&
+            record[1] + record[2] <= disk->fatBlockCount * disk->fatEntriesPerBlock)
+        {
+            // A record may cross into the next FAT block, each page takes its part
+            for (int first = record[1]; first < record[1] + record[2];)
+            {
+                int fatBlock = first / disk->fatEntriesPerBlock;
+                int count = (fatBlock + 1) * disk->fatEntriesPerBlock - first;
+                count = (count < record[1] + record[2] - first) ? count : record[1] + record[2] - first;
+                struct fatPage *page = getFatPage(fatBlock);
+                if (page == NULL)
+                {
+                    return -1;
+                }
+                memcpy(page->journaled + first % disk->fatEntriesPerBlock, record + 3 + first - record[1], (size_t)count * FAT_ENTRY_SIZE);
+                disk->fatBlockCheckpoint[fatBlock] = 1;
+                first += count;
+            }
+            offset += (3 + record[2]) * FAT_ENTRY_SIZE;
+        }
+        else if (record[0] == JOURNAL_RECORD_DIR && record[1] >= 0 && record[1] < DIR_ENTRY_MAX &&
+                 reserveJournaledDirectory(record[1] / disk->dirEntriesPerBlock + 1) == 0)
+        {
+            memcpy(disk->journaledRootDirectory + (size_t)record[1] * DIR_ENTRY_SIZE, record + 2, DIR_ENTRY_SIZE);
+            disk->rootDirBlockCheckpoint[record[1] / disk->dirEntriesPerBlock] = 1;
+            offset += 8 + DIR_ENTRY_SIZE;
+        }
+        else if (record[0] == JOURNAL_RECORD_SUPER)
+        {
+            disk->journaledFreeBlockCount = record[1];
+            disk->journaledFileCount = record[2];
+            offset += 12;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return (0);
+}
+
+unsigned int journalChecksum(char *data, int length, int sequence)
+{
+    // FNV-1a, seeded with the sequence so a stale transaction never matches
+    unsigned int hash = 2166136261u ^ (unsigned int)sequence;
+    for (int i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int commitJournalTransaction(int recordBytes)
+{
+    int blockCount = (JOURNAL_HEADER_SIZE + recordBytes + disk->blockSize - 1) / disk->blockSize;
+
+    // A full journal is checkpointed before the new transaction goes in
+    if (disk->journalHead + blockCount > disk->journalBlockCount && checkpointJournal() == -1)
+    {
+        return -1;
+    }
+
+    int *header = (int *)disk->journalBuffer;
+    memset(header, 0, JOURNAL_HEADER_SIZE);
+    header[0] = JOURNAL_MAGIC;
+    header[1] = disk->journalSequence;
+    header[2] = blockCount;
+    header[3] = recordBytes;
+    header[4] = journalChecksum(disk->journalBuffer + JOURNAL_HEADER_SIZE, recordBytes, disk->journalSequence);
+    memset(disk->journalBuffer + JOURNAL_HEADER_SIZE + recordBytes, 0, (size_t)blockCount * disk->blockSize - JOURNAL_HEADER_SIZE - recordBytes);
+
+    // One sequential write and one sync make the whole transaction durable
+    if (write_block_run(disk->journalBuffer, disk->journalStart + disk->journalHead, blockCount) == -1 || syncVirtualDisk() == -1)
+    {
+        return -1;
+    }
+
+    applyJournalRecords(disk->journalBuffer + JOURNAL_HEADER_SIZE, recordBytes);
+    disk->journalHead += blockCount;
+    disk->journalSequence++;
+
+    // Directory blocks linked by the transaction are checkpointed with the rest of the directory
+    return loadJournaledDirectory(0);
+}
+
+int checkpointJournal()
+{
+    // Committed metadata goes to its home blocks, then the superblock retires the journal
+    if (flushDirtyMetadataBlocks(disk->fatBlockCheckpoint, disk->fatBlockCount, FAT_BLOCK_START, NULL, fillFatBlock) == -1 ||
+        flushDirtyMetadataBlocks(disk->rootDirBlockCheckpoint, disk->journaledDirectoryBlockCount, disk->rootDirStart, disk->journaledDirectoryBlocks, fillRootDirectoryBlock) == -1 ||
+        syncVirtualDisk() == -1)
+    {
+        return -1;
+    }
+
+    disk->journalHead = 0;
+    if (setSuperblock() == -1 || syncVirtualDisk() == -1)
+    {
+        return -1;
+    }
+    return (0);
+}
+
+int loadJournaledMetadata()
+{
+    memset(disk->fatBlockCheckpoint, 0, disk->fatBlockCount);
+    memset(disk->rootDirBlockCheckpoint, 0, sizeof(disk->rootDirBlockCheckpoint));
+
+    disk->journaledDirectoryBlockCount = 0;
+    disk->journaledDirectoryCapacity = 0;
+
+    // FAT pages load from their home blocks when the directory chain or replay reaches them
+    if (reserveJournalBuffer(JOURNAL_FIXED_SIZE) == -1 || loadJournaledDirectory(1) == -1)
+    {
+        return -1;
+    }
+    return (0);
+}
+
+int loadJournaledDirectory(int readFromDisk)
+{
+    // Walk the journaled directory chain past the blocks already known
+    int blockCount = disk->journaledDirectoryBlockCount;
+    int block = (blockCount == 0) ? disk->rootDirStart : getJournaledFatEntry(disk->journaledDirectoryBlocks[blockCount - 1]);
+    while (block != EOF_FLAG)
+    {
+        if ((block < disk->metadataBlockCount && (block < disk->rootDirStart || block >= disk->rootDirStart + ROOT_DIR_COUNT)) ||
+            block >= disk->totalBlockCount || blockCount == disk->directoryBlockLimit)
+        {
+            printf("ERROR: The directory chain is broken at block %d!\n", block);
+            return -1;
+        }
+        disk->journaledDirectoryBlocks[blockCount++] = block;
+        block = getJournaledFatEntry(block);
+    }
+    if (reserveJournaledDirectory(blockCount) == -1)
+    {
+        return -1;
+    }
+
+    for (int i = disk->journaledDirectoryBlockCount; i < blockCount; i++)
+    {
+        char *data = disk->journaledRootDirectory + (size_t)i * disk->blockSize;
+        if (readFromDisk)
+        {
+            // Adjacent blocks of the chain are read together
+            int runLength = 1;
+            while (i + runLength < blockCount && disk->journaledDirectoryBlocks[i + runLength] == disk->journaledDirectoryBlocks[i] + runLength)
+            {
+                runLength++;
+            }
+            if (read_block_run((void *)data, disk->journaledDirectoryBlocks[i], runLength) == -1)
+            {
+                return -1;
+            }
+            i += runLength - 1;
+        }
+        else
+        {
+            // A block that joined the directory in a transaction holds its journaled entries or zeros
+            disk->rootDirBlockCheckpoint[i] = 1;
+        }
+    }
+    disk->journaledDirectoryBlockCount = blockCount;
+    return (0);
+}
+
+int reserveJournaledDirectory(int blockCount)
+{
+    if (blockCount <= disk->journaledDirectoryCapacity)
+    {
+        return (0);
+    }
+
+    char *directory = realloc(disk->journaledRootDirectory, (size_t)blockCount * disk->blockSize);
+    if (directory == NULL)
+    {
+        return -1;
+    }
+    disk->journaledRootDirectory = directory;
+    memset(disk->journaledRootDirectory + (size_t)disk->journaledDirectoryCapacity * disk->blockSize, 0,
+           (size_t)(blockCount - disk->journaledDirectoryCapacity) * disk->blockSize);
+    disk->journaledDirectoryCapacity = blockCount;
+    return (0);
+}
+
+int reserveJournalBuffer(size_t size)
+{
+    if (size <= disk->journalBufferSize)
+    {
+        return (0);
+    }
+
+    char *buffer = realloc(disk->journalBuffer, size);
+    if (buffer == NULL)
+    {
+        printf("ERROR: Could not allocate the journal buffer!\n");
+        return -1;
+    }
+    disk->journalBuffer = buffer;
+    disk->journalBufferSize = size;
+    return (0);
+}
+
+int replayJournal()
+{
+    int *header = (int *)disk->journalBuffer;
+    int replayed = 0;
+
+    disk->journalHead = 0;
+    while (disk->journalHead < disk->journalBlockCount)
+    {
+        if (read_block((void *)disk->journalBuffer, disk->journalStart + disk->journalHead) == -1)
+        {
+            return -1;
+        }
+
+        // The journal ends at the first block that does not start the next transaction
+        int blockCount = header[2];
+        int recordBytes = header[3];
+        if (header[0] != JOURNAL_MAGIC || header[1] != disk->journalSequence || blockCount < 1 ||
+            disk->journalHead + blockCount > disk->journalBlockCount || recordBytes < 0 ||
+            JOURNAL_HEADER_SIZE + recordBytes > blockCount * disk->blockSize)
+        {
+            break;
+        }
+        if (reserveJournalBuffer((size_t)blockCount * disk->blockSize) == -1)
+        {
+            return -1;
+        }
+        header = (int *)disk->journalBuffer;
+        if (blockCount > 1 && read_block_run((void *)(disk->journalBuffer + disk->blockSize), disk->journalStart + disk->journalHead + 1, blockCount - 1) == -1)
+        {
+            return -1;
+        }
+
+        // A transaction torn by a crash fails the checksum and is dropped
+        if ((unsigned int)header[4] != journalChecksum(disk->journalBuffer + JOURNAL_HEADER_SIZE, recordBytes, disk->journalSequence) ||
+            applyJournalRecords(disk->journalBuffer + JOURNAL_HEADER_SIZE, recordBytes) == -1)
+        {
+            break;
+        }
+
+        disk->journalHead += blockCount;
+        disk->journalSequence++;
+        replayed++;
+    }
+
+    if (replayed == 0)
+    {
+        disk->journalHead = 0;
+        return (0);
+    }
+
+    // The free summary predates the replayed transactions, regions they changed are counted again once loaded
+    for (int i = 0; i < disk->fatBlockCount; i++)
+    {
+        if (disk->fatBlockCheckpoint[i])
+        {
+            disk->freeSummary[i / disk->summaryRegionPages] = FREE_SUMMARY_UNKNOWN;
+        }
+    }
+
+    // Replay passes through older states of the chain, so the directory is walked once at the end
+    if (loadJournaledDirectory(0) == -1)
+    {
+        return -1;
+    }
+    return checkpointJournal();
+}
+
+int syncVirtualDisk()
+{
+    if (disk->mappedDisk != NULL)
+    {
+        return flushMappedDisk();
+    }
+    return (fsync(disk->vs_fd) == 0) ? 0 : -1;
+}
+
+void *flushThreadMain(void *arg)
+{
+    // The thread works on the disk that started it
+    disk = arg;
+    pthread_mutex_lock(&disk->flushThreadLock);
+    while (disk->flushThreadRunning)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += disk->flushInterval / 1000;
+        deadline.tv_nsec += (disk->flushInterval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(&disk->flushThreadWake, &disk->flushThreadLock, &deadline);
+        if (!disk->flushThreadRunning)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&disk->flushThreadLock);
+        flushAllDelayedAppends();
+        flushMetadata();
+        pthread_mutex_lock(&disk->flushThreadLock);
+    }
+    pthread_mutex_unlock(&disk->flushThreadLock);
+    return NULL;
+}
+
+void startFlushThread()
+{
+    pthread_mutex_lock(&disk->flushThreadLock);
+    disk->flushThreadRunning = 1;
+    pthread_mutex_unlock(&disk->flushThreadLock);
+
+    if (pthread_create(&disk->flushThread, NULL, flushThreadMain, disk) != 0)
+    {
+        printf("WARNING: Could not start the flush thread, flushing on sync only!\n");
+        disk->flushThreadRunning = 0;
+    }
+}
+
+void stopFlushThread()
+{
+    pthread_mutex_lock(&disk->flushThreadLock);
+    int running = disk->flushThreadRunning;
+    disk->flushThreadRunning = 0;
+    pthread_cond_signal(&disk->flushThreadWake);
+    pthread_mutex_unlock(&disk->flushThreadLock);
+
+    if (running)
+    {
+        pthread_join(disk->flushThread, NULL);
+    }
+}
+
+void clearOpenFileTable()
+{
+    // Chunks are added as descriptors are needed
+    disk->openFileTableSize = 0;
+    disk->freeDescriptorCount = 0;
+    disk->openFileCount = 0;
+}
+
+int growOpenFileTable()
+{
+    if (disk->openFileTableSize == MAX_NOF_OPEN_FILES)
+    {
+        return -1;
+    }
+    int chunk = disk->openFileTableSize / OPEN_FILE_CHUNK_ENTRIES;
+
+    // Memory is prepared first, nothing is published if it fails
+    struct fileStruct *files = calloc(OPEN_FILE_CHUNK_ENTRIES, sizeof(struct fileStruct));
+    int *descriptors = realloc(disk->freeDescriptors, (size_t)(disk->openFileTableSize + OPEN_FILE_CHUNK_ENTRIES) * sizeof(int));
+    if (files == NULL || descriptors == NULL)
+    {
+        free(files);
+        disk->freeDescriptors = (descriptors != NULL) ? descriptors : disk->freeDescriptors;
+        return -1;
+    }
+    disk->freeDescriptors = descriptors;
+
+    // Pushed in reverse so the lowest descriptor is handed out first
+    for (int i = OPEN_FILE_CHUNK_ENTRIES - 1; i >= 0; i--)
+    {
+        files[i].dirBlock = -1;
+        pthread_mutex_init(&(files[i].lock), NULL);
+        disk->freeDescriptors[disk->freeDescriptorCount++] = disk->openFileTableSize + i;
+    }
+    disk->openFileTable[chunk] = files;
+    __atomic_store_n(&disk->openFileTableSize, disk->openFileTableSize + OPEN_FILE_CHUNK_ENTRIES, __ATOMIC_RELEASE);
+    return (0);
+}
+
+void destroyOpenFileTable()
+{
+    for (int i = 0; i < OPEN_FILE_CHUNK_COUNT; i++)
+    {
+        if (disk->openFileTable[i] == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < OPEN_FILE_CHUNK_ENTRIES; j++)
+        {
+            pthread_mutex_destroy(&(disk->openFileTable[i][j].lock));
+        }
+        free(disk->openFileTable[i]);
+        disk->openFileTable[i] = NULL;
+    }
+
+    free(disk->freeDescriptors);
+    disk->freeDescriptors = NULL;
+    clearOpenFileTable();
+}
+
+struct fileStruct *getOpenFile(int fd)
+{
+    return &(disk->openFileTable[fd / OPEN_FILE_CHUNK_ENTRIES][fd % OPEN_FILE_CHUNK_ENTRIES]);
+}
+
+int isOpenDescriptor(int fd)
+{
+    return fd >= 0 && fd < __atomic_load_n(&disk->openFileTableSize, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&(getOpenFile(fd)->dirBlock), __ATOMIC_ACQUIRE) != -1;
+}
+
+struct dirEntry *getDirectoryEntry(int cacheIndex)
+{
+    return &(disk->cachedRootDirectory[cacheIndex / DIR_CHUNK_ENTRIES][cacheIndex % DIR_CHUNK_ENTRIES]);
+}
+
+int findAvailableDirectoryEntryIndex()
+{
+    // Add a block to the directory when every entry is used
+    if (disk->freeDirectorySlotCount == 0 && growDirectory() == -1)
+    {
+        return -1;
+    }
+
+    return disk->freeDirectorySlots[--disk->freeDirectorySlotCount];
+}
+
+int isRootPath(char *path)
+{
+    while (*path == PATH_SEPARATOR)
+    {
+        path++;
+    }
+    return *path == '\0';
+}
+
+int resolveParentDirectory(char *path, int *parentIndex, char *name)
+{
+    // Every component but the last has to be a directory, a leading separator is optional
+    int parent = ROOT_DIRECTORY_INDEX;
+    char *component = (*path == PATH_SEPARATOR) ? path + 1 : path;
+    while (1)
+    {
+        char *end = strchr(component, PATH_SEPARATOR);
+        int length = (end == NULL) ? (int)strlen(component) : (int)(end - component);
+        if (length == 0 || length > MAX_FILENAME_LENGTH)
+        {
+            printf("ERROR: Invalid path %s!\n", path);
+            return -1;
+        }
+
+        memset(name, 0, MAX_FILENAME_LENGTH);
+        memcpy(name, component, length);
+        if (end == NULL)
+        {
+            break;
+        }
+
+        // Each step is one lookup in the filename index, no directory block is read
+        parent = findChildEntryIndex(parent, name);
+        if (parent == -1 || getDirectoryEntry(parent)->type != TYPE_DIRECTORY)
+        {
+            printf("ERROR: Directory of %s does not exist!\n", path);
+            return -1;
+        }
+        component = end + 1;
+    }
+
+    *parentIndex = parent;
+    return (0);
+}
+
+int findDirectoryEntryIndexByPath(char *path)
+{
+    int parentIndex;
+    char name[MAX_FILENAME_LENGTH];
+    if (resolveParentDirectory(path, &parentIndex, name) == -1)
+    {
+        return -1;
+    }
+    return findChildEntryIndex(parentIndex, name);
+}
+
+int findChildEntryIndex(int parentIndex, char *name)
+{
+    // Appends rewrite entries under the directory lock
+    pthread_mutex_lock(&disk->directoryLock);
+    int i = disk->filenameHash[hashFilename(parentIndex, name)];
+    while (i != -1 && (getDirectoryEntry(i)->parent != parentIndex ||
+                       strncmp(name, getDirectoryEntry(i)->filename, MAX_FILENAME_LENGTH) != 0))
+    {
+        i = getDirectoryEntry(i)->hashNext;
+    }
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    // -1 if it could not be found
+    return i;
+}
+
+unsigned int hashFilename(int parentIndex, char *filename)
+{
+    // FNV-1a over the parent entry and the stored part of the name
+    unsigned int hash = (2166136261u ^ (unsigned int)parentIndex) * 16777619u;
+    for (int i = 0; i < MAX_FILENAME_LENGTH && filename[i] != '\0'; i++)
+    {
+        hash = (hash ^ (unsigned char)filename[i]) * 16777619u;
+    }
+    return hash & (disk->filenameHashSize - 1);
+}
+
+void insertFilenameIndex(int cacheIndex)
+{
+    pthread_mutex_lock(&disk->directoryLock);
+
+    linkChildEntry(cacheIndex);
+
+    // Rehash into four times the buckets when the chains get longer than half an entry on average
+    if ((disk->filenameHashEntries + 1) * 2 > disk->filenameHashSize && rehashFilenameIndex(disk->filenameHashSize * 4) == 0)
+    {
+        // The entry is already allocated, so the rehash indexed it
+        pthread_mutex_unlock(&disk->directoryLock);
+        return;
+    }
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    unsigned int bucket = hashFilename(tmpDirEntry->parent, tmpDirEntry->filename);
+    tmpDirEntry->hashNext = disk->filenameHash[bucket];
+    disk->filenameHash[bucket] = cacheIndex;
+    disk->filenameHashEntries++;
+    pthread_mutex_unlock(&disk->directoryLock);
+}
+
+void removeFilenameIndex(int cacheIndex)
+{
+    unlinkChildEntry(cacheIndex);
+
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    int *link = &(disk->filenameHash[hashFilename(tmpDirEntry->parent, tmpDirEntry->filename)]);
+    while (*link != -1 && *link != cacheIndex)
+    {
+        link = &(getDirectoryEntry(*link)->hashNext);
+    }
+    if (*link == cacheIndex)
+    {
+        *link = getDirectoryEntry(cacheIndex)->hashNext;
+        disk->filenameHashEntries--;
+    }
+}
+
+int buildFilenameIndex()
+{
+    int size = FILENAME_HASH_MIN_SIZE;
+    while (size < disk->fileCount * 2)
+    {
+        size *= 2;
+    }
+
+    pthread_mutex_lock(&disk->directoryLock);
+    int res = rehashFilenameIndex(size);
+    disk->rootFirstChild = -1;
+    for (int i = disk->directoryEntryCount - 1; i >= 0; i--)
+    {
+        if (getDirectoryEntry(i)->allocated == USED_FLAG)
+        {
+            linkChildEntry(i);
+        }
+    }
+    pthread_mutex_unlock(&disk->directoryLock);
+    return res;
+}
+
+int *findChildList(int parentIndex)
+{
+    return (parentIndex == ROOT_DIRECTORY_INDEX) ? &disk->rootFirstChild : &(getDirectoryEntry(parentIndex)->firstChild);
+}
+
+void linkChildEntry(int cacheIndex)
+{
+    // Newest entries are listed first
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    int *firstChild = findChildList(tmpDirEntry->parent);
+    tmpDirEntry->prevSibling = -1;
+    tmpDirEntry->nextSibling = *firstChild;
+    if (*firstChild != -1)
+    {
+        getDirectoryEntry(*firstChild)->prevSibling = cacheIndex;
+    }
+    *firstChild = cacheIndex;
+}
+
+void unlinkChildEntry(int cacheIndex)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    if (tmpDirEntry->prevSibling != -1)
+    {
+        getDirectoryEntry(tmpDirEntry->prevSibling)->nextSibling = tmpDirEntry->nextSibling;
+    }
+    else
+    {
+        *findChildList(tmpDirEntry->parent) = tmpDirEntry->nextSibling;
+    }
+    if (tmpDirEntry->nextSibling != -1)
+    {
+        getDirectoryEntry(tmpDirEntry->nextSibling)->prevSibling = tmpDirEntry->prevSibling;
+    }
+}
+
+int rehashFilenameIndex(int size)
+{
+    int *buckets = malloc((size_t)size * sizeof(int));
+    if (buckets == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < size; i++)
+    {
+        buckets[i] = -1;
+    }
+
+    free(disk->filenameHash);
+    disk->filenameHash = buckets;
+    disk->filenameHashSize = size;
+    disk->filenameHashEntries = 0;
+    for (int i = 0; i < disk->directoryEntryCount; i++)
+    {
+        if (getDirectoryEntry(i)->allocated == USED_FLAG)
+        {
+            unsigned int bucket = hashFilename(getDirectoryEntry(i)->parent, getDirectoryEntry(i)->filename);
+            getDirectoryEntry(i)->hashNext = disk->filenameHash[bucket];
+            disk->filenameHash[bucket] = i;
+            disk->filenameHashEntries++;
+        }
+    }
+    return (0);
+}
+
+int createFatTable()
+{
+    disk->fatPages = calloc(disk->fatBlockCount, sizeof(struct fatPage *));
+    disk->fatBlockDirty = calloc(disk->fatBlockCount, 1);
+    disk->fatBlockCheckpoint = calloc(disk->fatBlockCount, 1);
+    disk->pendingFreeCount = 0;
+    disk->nextFitBlock = 0;
+    memset(disk->regionLoadedPages, 0, sizeof(disk->regionLoadedPages));
+    if (disk->fatPages == NULL || disk->fatBlockDirty == NULL || disk->fatBlockCheckpoint == NULL)
+    {
+        destroyFatTable();
+        return -1;
+    }
+    return (0);
+}
+
+void destroyFatTable()
+{
+    if (disk->fatPages != NULL)
+    {
+        for (int i = 0; i < disk->fatBlockCount; i++)
+        {
+            free(disk->fatPages[i]);
+        }
+    }
+    free(disk->fatPages);
+    free(disk->fatBlockDirty);
+    free(disk->fatBlockCheckpoint);
+    disk->fatPages = NULL;
+    disk->fatBlockDirty = NULL;
+    disk->fatBlockCheckpoint = NULL;
+
+    // The journal buffer grows with the FAT blocks a transaction changes
+    free(disk->journalBuffer);
+    disk->journalBuffer = NULL;
+    disk->journalBufferSize = 0;
+}
+
+struct fatPage *getFatPage(int fatBlock)
+{
+    if (fatBlock < 0 || fatBlock >= disk->fatBlockCount)
+    {
+        return NULL;
+    }
+
+    // Loaded pages never move, so they are used without a lock
+    struct fatPage *page = __atomic_load_n(&disk->fatPages[fatBlock], __ATOMIC_ACQUIRE);
+    return (page != NULL) ? page : loadFatPage(fatBlock);
+}
+
+struct fatPage *loadFatPage(int fatBlock)
+{
+    pthread_mutex_lock(&disk->fatPageLock);
+    struct fatPage *page = disk->fatPages[fatBlock];
+    if (page == NULL)
+    {
+        // One allocation holds the page and its arrays, sized by the block size
+        size_t bitmapBytes = (size_t)disk->bitmapWordCount * sizeof(unsigned long long);
+        page = malloc(sizeof(struct fatPage) + 3 * bitmapBytes + 2 * (size_t)disk->blockSize);
+        if (page != NULL)
+        {
+            page->freeBits = (unsigned long long *)(page + 1);
+            page->pendingFreeBits = page->freeBits + disk->bitmapWordCount;
+            page->committingFreeBits = page->pendingFreeBits + disk->bitmapWordCount;
+            page->entries = (int *)(page->committingFreeBits + disk->bitmapWordCount);
+            page->journaled = page->entries + disk->fatEntriesPerBlock;
+        }
+
+        // The home block holds the committed entries, nothing changes a page before it is loaded
+        if (page == NULL || read_block((void *)page->journaled, FAT_BLOCK_START + fatBlock) == -1)
+        {
+            printf("ERROR: Could not load FAT block %d!\n", fatBlock);
+            free(page);
+            pthread_mutex_unlock(&disk->fatPageLock);
+            return NULL;
+        }
+        memcpy(page->entries, page->journaled, disk->blockSize);
+        buildFreeBlockBits(page);
+        memset(page->pendingFreeBits, 0, bitmapBytes);
+        memset(page->committingFreeBits, 0, bitmapBytes);
+        __atomic_store_n(&disk->fatPages[fatBlock], page, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&disk->regionLoadedPages[fatBlock / disk->summaryRegionPages], 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&disk->fatPageLock);
+    return page;
+}
+
+int getFatEntry(int block)
+{
+    struct fatPage *page = getFatPage(block >> disk->fatEntryShift);
+    return (page != NULL && block >= 0) ? page->entries[block & (disk->fatEntriesPerBlock - 1)] : EOF_FLAG;
+}
+
+void setFatEntry(int block, int data)
+{
+    struct fatPage *page = getFatPage(block >> disk->fatEntryShift);
+    if (page != NULL && block >= 0)
+    {
+        page->entries[block & (disk->fatEntriesPerBlock - 1)] = data;
+    }
+}
+
+int getJournaledFatEntry(int block)
+{
+    struct fatPage *page = getFatPage(block >> disk->fatEntryShift);
+    return (page != NULL && block >= 0) ? page->journaled[block & (disk->fatEntriesPerBlock - 1)] : EOF_FLAG;
+}
+
+void buildFreeBlockBits(struct fatPage *page)
+{
+    memset(page->freeBits, 0, (size_t)disk->bitmapWordCount * sizeof(unsigned long long));
+    for (int i = 0; i < disk->fatEntriesPerBlock; i++)
+    {
+        if (page->entries[i] == NOT_USED_FLAG)
+        {
+            page->freeBits[i / BITMAP_WORD_BITS] |= 1ULL << (i % BITMAP_WORD_BITS);
+        }
+    }
+}
+
+unsigned long long getFreeBlockWord(int word)
+{
+    // A page that can not be loaded has no free blocks
+    struct fatPage *page = getFatPage(word / disk->bitmapWordCount);
+    return (page != NULL) ? page->freeBits[word % disk->bitmapWordCount] : 0;
+}
+
+int getRegionPageCount(int region)
+{
+    int pages = disk->fatBlockCount - region * disk->summaryRegionPages;
+    return (pages < disk->summaryRegionPages) ? pages : disk->summaryRegionPages;
+}
+
+int countRegionFreeBlocks(int region)
+{
+    // Blocks waiting for a commit are added when it is durable
+    int count = 0;
+    for (int i = region * disk->summaryRegionPages; i < region * disk->summaryRegionPages + getRegionPageCount(region); i++)
+    {
+        struct fatPage *page = __atomic_load_n(&disk->fatPages[i], __ATOMIC_ACQUIRE);
+        for (int j = 0; page != NULL && j < disk->bitmapWordCount; j++)
+        {
+            count += __builtin_popcountll(page->freeBits[j]);
+        }
+    }
+    return count;
+}
+
+void updateFreeSummary(int block, int delta)
+{
+    int region = (block >> disk->fatEntryShift) / disk->summaryRegionPages;
+    if (disk->freeSummary[region] != FREE_SUMMARY_UNKNOWN)
+    {
+        disk->freeSummary[region] = (disk->freeSummary[region] + delta > 0) ? disk->freeSummary[region] + delta : 0;
+    }
+}
+
+void forgetFreeSummary(int onlyEmpty)
+{
+    // Regions not fully loaded are searched again, every page of a loaded region is at hand anyway
+    for (int i = 0; i < disk->freeSummaryRegions && i * disk->summaryRegionPages < disk->fatBlockCount; i++)
+    {
+        if ((!onlyEmpty || disk->freeSummary[i] == 0) &&
+            __atomic_load_n(&disk->regionLoadedPages[i], __ATOMIC_RELAXED) < getRegionPageCount(i))
+        {
+            disk->freeSummary[i] = FREE_SUMMARY_UNKNOWN;
+        }
+    }
+}
+
+int findNextFreeBlock(int from, int to, int useSummary)
+{
+    int regionWords = disk->summaryRegionPages * disk->bitmapWordCount;
+    int word = from / BITMAP_WORD_BITS;
+    unsigned long long mask = ~0ULL << (from % BITMAP_WORD_BITS);
+
+    while ((long long)word * BITMAP_WORD_BITS < to)
+    {
+        // A region the summary reports as full is skipped unless its pages are loaded already
+        int region = word / regionWords;
+        if (useSummary && disk->freeSummary[region] == 0 &&
+            __atomic_load_n(&disk->regionLoadedPages[region], __ATOMIC_RELAXED) < getRegionPageCount(region))
+        {
+            word = (region + 1) * regionWords;
+            mask = ~0ULL;
+            continue;
+        }
+
+        // Mask the bits below from in the first word, then skip full words
+        unsigned long long bits = getFreeBlockWord(word) & mask;
+        if (bits != 0)
+        {
+            int block = word * BITMAP_WORD_BITS + __builtin_ctzll(bits);
+            return (block < to) ? block : -1;
+        }
+        word++;
+        mask = ~0ULL;
+    }
+    return -1;
+}
+
+int countFreeRun(int start, int limit)
+{
+    int length = 0;
+    while (length < limit && start + length < disk->totalBlockCount)
+    {
+        int block = start + length;
+        int bitsLeft = BITMAP_WORD_BITS - block % BITMAP_WORD_BITS;
+        unsigned long long bits = getFreeBlockWord(block / BITMAP_WORD_BITS) >> (block % BITMAP_WORD_BITS);
+
+        // Consecutive free blocks are the trailing ones of the shifted word
+        int ones = (~bits == 0) ? BITMAP_WORD_BITS : __builtin_ctzll(~bits);
+        length += ones;
+        if (ones < bitsLeft)
+        {
+            break;
+        }
+    }
+
+    return (length < limit) ? length : limit;
+}
+
+int findAvailableBlockRun(int goal, int wanted, int *runLength)
+{
+    // Extend the current extent of the file when the block after it is free
+    if (goal >= 0 && goal < disk->totalBlockCount && countFreeRun(goal, 1) == 1)
+    {
+        *runLength = countFreeRun(goal, wanted);
+        return goal;
+    }
+
+    // Otherwise start a new extent in a run at least the allocation window long
+    int desired = (wanted > disk->allocationWindow) ? wanted : disk->allocationWindow;
+    int longestStart = -1;
+    int longestLength = 0;
+    int candidates = 0;
+    int cursor = disk->nextFitBlock;
+
+    // Next-fit: search from the cursor to the end, then wrap around.
+    // Both passes trust the free summary, a stale summary is caught by a last pass over the whole disk.
+    // A fragmented disk may hold no run the window long, the search settles for the longest of the first few.
+    for (int pass = 0; pass < 3 && (pass < 2 || longestStart == -1); pass++)
+    {
+        if (pass == 2)
+        {
+            forgetFreeSummary(1);
+        }
+        int from = (pass == 0) ? cursor : 0;
+        int to = (pass == 1) ? cursor : disk->totalBlockCount;
+        int start;
+        while ((start = findNextFreeBlock(from, to, pass < 2)) != -1)
+        {
+            int length = countFreeRun(start, desired);
+            if (length > longestLength)
             {
-                readFromBlockToBuffer(bufferPtr, blockPtr, logicalStartBlockOffset, BLOCKSIZE, &byteCount);
+                longestStart = start;
+                longestLength = length;
             }
-            // End partial block read
-            else if (i == logicalEndBlock)
+            if (length == desired || ++candidates == ALLOCATION_SEARCH_RUNS)
             {
-                readFromBlockToBuffer(bufferPtr, blockPtr, 0, logicalEndBlockOffset, &byteCount);
+                pass = 3;
+                break;
             }
-            // Mid full block read
-            else
+            from = start + length;
+        }
+    }
+
+    if (longestStart == -1)
+    {
+        // If not empty entry found
+        return -1;
+    }
+
+    // Leave the rest of the window free so the file can keep growing in place
+    *runLength = (longestLength < wanted) ? longestLength : wanted;
+    disk->nextFitBlock = (longestStart + longestLength) % disk->totalBlockCount;
+    return longestStart;
+}
+
+void setBlockFreeBit(int block, int isFree)
+{
+    struct fatPage *page = getFatPage(block >> disk->fatEntryShift);
+    int bit = block & (disk->fatEntriesPerBlock - 1);
+    if (page == NULL || block < 0)
+    {
+        return;
+    }
+
+    unsigned long long *word = &(page->freeBits[bit / BITMAP_WORD_BITS]);
+    unsigned long long mask = 1ULL << (bit % BITMAP_WORD_BITS);
+    if (((*word & mask) != 0) != (isFree != 0))
+    {
+        updateFreeSummary(block, isFree ? 1 : -1);
+    }
+
+    if (isFree)
+    {
+        *word |= mask;
+    }
+    else
+    {
+        *word &= ~mask;
+    }
+}
+
+int findAvailableOpenFileTableIndex()
+{
+    // Add a chunk of descriptors when every one is used
+    if (disk->freeDescriptorCount == 0 && growOpenFileTable() == -1)
+    {
+        return -1;
+    }
+    return disk->freeDescriptors[--disk->freeDescriptorCount];
+}
+
+int allocateBlockFatEntry(int cacheIndex, int data)
+{
+    // Allocate the FAT Entry on memory cache
+    setFatEntry(cacheIndex, data);
+    setBlockFreeBit(cacheIndex, data == NOT_USED_FLAG);
+
+    // The FAT block is written on the next metadata flush
+    disk->fatBlockDirty[cacheIndex >> disk->fatEntryShift] = 1;
+
+    // printf("LOG(allocateBlockFatEntry) (block no: %d) free block count: %d\n", cacheIndex, free_block_count);
+    return cacheIndex;
+};
+
+int allocateBlockRunForFile(int cacheIndex, int blockCount)
+{
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    int firstNewBlock = -1;
+
+    pthread_mutex_lock(&disk->allocatorLock);
+
+    // Check if enough available blocks exist on the virtual disk, blocks reserved for the file are its own
+    int available = disk->freeBlockCount - disk->pendingFreeCount - (disk->reservedBlockCount - tmpDirEntry->reservedBlocks);
+    if (blockCount > available)
+    {
+        printf("ERROR: Not enough free blocks available! required: %d  free:%d\n", blockCount, available);
+        pthread_mutex_unlock(&disk->allocatorLock);
+        return -1;
+    }
+    int reserved = (blockCount < tmpDirEntry->reservedBlocks) ? blockCount : tmpDirEntry->reservedBlocks;
+    tmpDirEntry->reservedBlocks -= reserved;
+    disk->reservedBlockCount -= reserved;
+    int oldLastBlock = tmpDirEntry->lastBlock;
+    int oldBlockCount = tmpDirEntry->blockCount;
+
+    while (blockCount > 0)
+    {
+        int runLength;
+        int goal = (tmpDirEntry->lastBlock != -1) ? tmpDirEntry->lastBlock + 1 : -1;
+        int runStart = findAvailableBlockRun(goal, blockCount, &runLength);
+
+        if (runStart == -1)
+        {
+            printf("ERROR: Block can not be allocated!\n");
+            releaseNewBlockRuns(tmpDirEntry, firstNewBlock, oldLastBlock, oldBlockCount, reserved);
+            pthread_mutex_unlock(&disk->allocatorLock);
+            return -1;
+        }
+
+        // Link the run into the FAT on memory cache
+        for (int i = runStart; i < runStart + runLength; i++)
+        {
+            setFatEntry(i, (i == runStart + runLength - 1) ? EOF_FLAG : i + 1);
+            setBlockFreeBit(i, 0);
+        }
+
+        // Every touched FAT block is written once on the next metadata flush
+        for (int i = runStart >> disk->fatEntryShift; i <= (runStart + runLength - 1) >> disk->fatEntryShift; i++)
+        {
+            disk->fatBlockDirty[i] = 1;
+        }
+
+        // The first run of an empty chain is linked by the caller through the directory entry
+        if (tmpDirEntry->lastBlock != -1)
+        {
+            setFatEntry(tmpDirEntry->lastBlock, runStart);
+            disk->fatBlockDirty[tmpDirEntry->lastBlock >> disk->fatEntryShift] = 1;
+        }
+
+        if (firstNewBlock == -1)
+        {
+            firstNewBlock = runStart;
+        }
+
+        // Last block of the run becomes the tail of the file
+        disk->freeBlockCount -= runLength;
+        tmpDirEntry->lastBlock = runStart + runLength - 1;
+        tmpDirEntry->blockCount += runLength;
+        blockCount -= runLength;
+    }
+
+    pthread_mutex_unlock(&disk->allocatorLock);
+    return firstNewBlock;
+}
+
+void releaseNewBlockRuns(struct dirEntry *tmpDirEntry, int firstNewBlock, int oldLastBlock, int oldBlockCount, int reserved)
+{
+    // The runs never reached the journal, so their blocks are free again right away
+    int block = firstNewBlock;
+    while (block != EOF_FLAG)
+    {
+        int nextBlock = getFatEntry(block);
+        setFatEntry(block, NOT_USED_FLAG);
+        setBlockFreeBit(block, 1);
+        disk->fatBlockDirty[block >> disk->fatEntryShift] = 1;
+        disk->freeBlockCount++;
+        block = nextBlock;
+    }
+
+    // The file ends at its old tail with its old reservation
+    if (oldLastBlock != -1)
+    {
+        setFatEntry(oldLastBlock, EOF_FLAG);
+        disk->fatBlockDirty[oldLastBlock >> disk->fatEntryShift] = 1;
+    }
+    tmpDirEntry->lastBlock = oldLastBlock;
+    tmpDirEntry->blockCount = oldBlockCount;
+    tmpDirEntry->reservedBlocks += reserved;
+    disk->reservedBlockCount += reserved;
+}
+
+void fillFatBlock(int fatBlock, char *block)
+{
+    // Only loaded pages are checkpointed
+    memcpy(block, getFatPage(fatBlock)->journaled, disk->blockSize);
+}
+
+void fillRootDirectoryBlock(int dirBlock, char *block)
+{
+    memcpy(block, disk->journaledRootDirectory + dirBlock * disk->blockSize, disk->blockSize);
+}
+
+int allocateDirectoryEntry(int cacheIndex, char *filename, int size, int startBlock, int allocationStatus, int parent, int type)
+{
+    pthread_mutex_lock(&disk->directoryLock);
+
+    // Allocate entry on cachedRootDirectory
+    memcpy(getDirectoryEntry(cacheIndex)->filename, filename, MAX_FILENAME_LENGTH);
+    getDirectoryEntry(cacheIndex)->size = size;
+    getDirectoryEntry(cacheIndex)->startBlock = startBlock;
+    getDirectoryEntry(cacheIndex)->allocated = allocationStatus;
+    getDirectoryEntry(cacheIndex)->parent = parent;
+    getDirectoryEntry(cacheIndex)->type = type;
+
+    // The directory block is written on the next metadata flush
+    markDirectoryBlockDirty(cacheIndex / disk->dirEntriesPerBlock);
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    return cacheIndex;
+}
+
+int resizeDirectoryEntry(int cacheIndex, int size, int startBlock)
+{
+    // Appends only change the extent, the name and type stay untouched for lookups under the namespace lock
+    pthread_mutex_lock(&disk->directoryLock);
+    getDirectoryEntry(cacheIndex)->size = size;
+    getDirectoryEntry(cacheIndex)->startBlock = startBlock;
+    markDirectoryBlockDirty(cacheIndex / disk->dirEntriesPerBlock);
+    pthread_mutex_unlock(&disk->directoryLock);
+
+    return cacheIndex;
+}
+
+void allocateOpenFileTableEntry(int fd, int cacheIndex, int accessMode)
+{
+    // Callers still waiting on a lock through an earlier open of the descriptor see a new generation
+    __atomic_add_fetch(&(getOpenFile(fd)->generation), 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&(getOpenFile(fd)->cachedRootDirIndex), cacheIndex, __ATOMIC_RELAXED);
+    getOpenFile(fd)->dirBlockOffset = cacheIndex % disk->dirEntriesPerBlock;
+    getOpenFile(fd)->accessMode = accessMode;
+    getOpenFile(fd)->positionPtr = 0;
+    // The cursor starts on the first access, appends may be moving the start block
+    getOpenFile(fd)->cursorLogicalBlock = 0;
+    getOpenFile(fd)->cursorBlock = -1;
+    getOpenFile(fd)->view = NULL;
+    getOpenFile(fd)->viewBlocks = NULL;
+    getOpenFile(fd)->viewBlockCount = 0;
+    getOpenFile(fd)->viewCopy = NULL;
+
+    // Descriptors of the file form a list, deleting the file closes them all
+    int next = getDirectoryEntry(cacheIndex)->openDescriptor;
+    getOpenFile(fd)->nextOpen = next;
+    getOpenFile(fd)->prevOpen = -1;
+    if (next != -1)
+    {
+        getOpenFile(next)->prevOpen = fd;
+    }
+    getDirectoryEntry(cacheIndex)->openDescriptor = fd;
+    disk->openFileCount++;
+    __atomic_store_n(&(getOpenFile(fd)->dirBlock), cacheIndex / disk->dirEntriesPerBlock, __ATOMIC_RELEASE);
+}
+
+int mapVirtualDisk()
+{
+    struct stat diskStat;
+    if (fstat(disk->vs_fd, &diskStat) == -1 || diskStat.st_size == 0)
+    {
+        return -1;
+    }
+
+    char *mapping = mmap(NULL, diskStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, disk->vs_fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    disk->mappedDisk = mapping;
+    disk->mappedDiskSize = diskStat.st_size;
+    disk->mappedDirtyStart = disk->mappedDiskSize;
+    disk->mappedDirtyEnd = 0;
+    return (0);
+}
+
+void unmapVirtualDisk()
+{
+    if (disk->mappedDisk == NULL)
+    {
+        return;
+    }
+
+    munmap(disk->mappedDisk, disk->mappedDiskSize);
+    disk->mappedDisk = NULL;
+}
+
+char *getMappedBlock(int block)
+{
+    return disk->mappedDisk + (size_t)block * disk->blockSize;
+}
+
+void markMappedRangeDirty(size_t offset, size_t length)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    if (offset < disk->mappedDirtyStart)
+    {
+        disk->mappedDirtyStart = offset;
+    }
+    if (offset + length > disk->mappedDirtyEnd)
+    {
+        disk->mappedDirtyEnd = offset + length;
+    }
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+int flushMappedDisk()
+{
+    // Take the dirty range, writes after this point extend a new one
+    pthread_mutex_lock(&disk->cacheLock);
+    size_t dirtyStart = disk->mappedDirtyStart;
+    size_t dirtyEnd = disk->mappedDirtyEnd;
+    disk->mappedDirtyStart = disk->mappedDiskSize;
+    disk->mappedDirtyEnd = 0;
+    pthread_mutex_unlock(&disk->cacheLock);
+
+    if (dirtyStart >= dirtyEnd)
+    {
+        return (0);
+    }
+
+    // msync needs a page aligned start address
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t start = dirtyStart / pageSize * pageSize;
+    int res = msync(disk->mappedDisk + start, dirtyEnd - start, MS_SYNC);
+    __atomic_add_fetch(&disk->ioStats.writeCalls, 1, __ATOMIC_RELAXED);
+    return (res == 0) ? 0 : -1;
+}
+
+int flushDirtyData()
+{
+    if (disk->mappedDisk != NULL)
+    {
+        return flushMappedDisk();
+    }
+
+    return flushBufferCache();
+}
+
+int initializeBufferCache()
+{
+    disk->bufferCacheHashSize = 1;
+    while (disk->bufferCacheHashSize < disk->bufferCacheSize * 2)
+    {
+        disk->bufferCacheHashSize <<= 1;
+    }
+
+    disk->bufferCache = calloc(disk->bufferCacheSize, sizeof(struct cacheBlock));
+    disk->bufferCacheHash = calloc(disk->bufferCacheHashSize, sizeof(struct cacheBlock *));
+    disk->writebackBlocks = malloc(disk->bufferCacheSize * sizeof(struct cacheBlock *));
+    char *data = malloc((size_t)disk->bufferCacheSize * disk->blockSize);
+    if (disk->bufferCache == NULL || disk->bufferCacheHash == NULL || disk->writebackBlocks == NULL || data == NULL)
+    {
+        free(disk->bufferCache);
+        free(disk->bufferCacheHash);
+        free(disk->writebackBlocks);
+        free(data);
+        disk->bufferCache = NULL;
+        disk->bufferCacheHash = NULL;
+        disk->writebackBlocks = NULL;
+        return -1;
+    }
+    disk->viewPinnedCount = 0;
+
+    // Chain every slot into the LRU list, all of them empty
+    for (int i = 0; i < disk->bufferCacheSize; i++)
+    {
+        disk->bufferCache[i].block = -1;
+        disk->bufferCache[i].data = data + (size_t)i * disk->blockSize;
+        disk->bufferCache[i].lruPrev = (i > 0) ? &(disk->bufferCache[i - 1]) : NULL;
+        disk->bufferCache[i].lruNext = (i < disk->bufferCacheSize - 1) ? &(disk->bufferCache[i + 1]) : NULL;
+    }
+    disk->lruHead = &(disk->bufferCache[0]);
+    disk->lruTail = &(disk->bufferCache[disk->bufferCacheSize - 1]);
+    return (0);
+}
+
+void destroyBufferCache()
+{
+    if (disk->bufferCache == NULL)
+    {
+        return;
+    }
+
+    free(disk->bufferCache[0].data);
+    free(disk->bufferCache);
+    free(disk->bufferCacheHash);
+    free(disk->writebackBlocks);
+    disk->bufferCache = NULL;
+    disk->bufferCacheHash = NULL;
+    disk->writebackBlocks = NULL;
+}
+
+struct cacheBlock **findCacheBucket(int block)
+{
+    return &(disk->bufferCacheHash[block & (disk->bufferCacheHashSize - 1)]);
+}
+
+void removeFromCacheBucket(struct cacheBlock *entry)
+{
+    struct cacheBlock **link = findCacheBucket(entry->block);
+    while (*link != entry)
+    {
+        link = &((*link)->hashNext);
+    }
+    *link = entry->hashNext;
+    entry->hashNext = NULL;
+}
+
+void moveToLruHead(struct cacheBlock *entry)
+{
+    if (entry == disk->lruHead)
+    {
+        return;
+    }
+
+    // Unlink
+    entry->lruPrev->lruNext = entry->lruNext;
+    if (entry->lruNext != NULL)
+    {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    }
+    else
+    {
+        disk->lruTail = entry->lruPrev;
+    }
+
+    // Link as the most recently used
+    entry->lruPrev = NULL;
+    entry->lruNext = disk->lruHead;
+    disk->lruHead->lruPrev = entry;
+    disk->lruHead = entry;
+}
+
+struct cacheBlock *findCachedBlock(int block)
+{
+    if (disk->bufferCache == NULL)
+    {
+        return NULL;
+    }
+
+    struct cacheBlock *entry = *findCacheBucket(block);
+    while (entry != NULL && entry->block != block)
+    {
+        entry = entry->hashNext;
+    }
+
+    return entry;
+}
+
+struct cacheBlock *getCachedBlock(int block, int readFromDisk)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    struct cacheBlock *entry = findCachedBlock(block);
+
+    if (entry != NULL)
+    {
+        disk->cacheStats.hits++;
+        entry->pinCount++;
+        moveToLruHead(entry);
+
+        // Another thread may still be reading the block from disk
+        while (entry->loading)
+        {
+            pthread_cond_wait(&disk->cacheSlotReady, &disk->cacheLock);
+        }
+
+        if (entry->block != block)
+        {
+            // Loading failed and the slot was dropped
+            entry->pinCount--;
+            entry = NULL;
+        }
+        pthread_mutex_unlock(&disk->cacheLock);
+        return entry;
+    }
+
+    // Miss, reuse the least recently used slot that is not pinned
+    disk->cacheStats.misses++;
+    entry = disk->lruTail;
+    while (entry != NULL && entry->pinCount > 0)
+    {
+        entry = entry->lruPrev;
+    }
+
+    if (entry == NULL)
+    {
+        pthread_mutex_unlock(&disk->cacheLock);
+        printf("ERROR: Every buffer cache slot is pinned!\n");
+        return NULL;
+    }
+
+    if (entry->block != -1)
+    {
+        disk->cacheStats.evictions++;
+        if (entry->dirty)
+        {
+            write_block((void *)entry->data, entry->block);
+            disk->cacheStats.writebacks++;
+        }
+        removeFromCacheBucket(entry);
+    }
+
+    entry->block = block;
+    entry->dirty = 0;
+    entry->pinCount = 1;
+    struct cacheBlock **bucket = findCacheBucket(block);
+    entry->hashNext = *bucket;
+    *bucket = entry;
+    moveToLruHead(entry);
+
+    if (readFromDisk)
+    {
+        // Read without holding the lock, hits on the slot wait for it
+        entry->loading = 1;
+        pthread_mutex_unlock(&disk->cacheLock);
+        int res = read_block((void *)entry->data, block);
+        pthread_mutex_lock(&disk->cacheLock);
+        entry->loading = 0;
+
+        if (res == -1)
+        {
+            removeFromCacheBucket(entry);
+            entry->block = -1;
+            entry->pinCount--;
+            entry = NULL;
+        }
+        pthread_cond_broadcast(&disk->cacheSlotReady);
+    }
+
+    pthread_mutex_unlock(&disk->cacheLock);
+    return entry;
+}
+
+void releaseCachedBlock(struct cacheBlock *entry)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    entry->pinCount--;
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+void invalidateCachedBlock(int block)
+{
+    pthread_mutex_lock(&disk->cacheLock);
+    struct cacheBlock *entry = findCachedBlock(block);
+
+    // Drop without writing back, the block no longer belongs to a file
+    if (entry != NULL && entry->pinCount == 0)
+    {
+        removeFromCacheBucket(entry);
+        entry->block = -1;
+        entry->dirty = 0;
+    }
+    pthread_mutex_unlock(&disk->cacheLock);
+}
+
+int compareCacheBlocks(const void *a, const void *b)
+{
+    return (*(struct cacheBlock **)a)->block - (*(struct cacheBlock **)b)->block;
+}
+
+int flushBufferCache()
+{
+    if (disk->bufferCache == NULL)
+    {
+        return (0);
+    }
+
+    // The slot list is allocated with the cache, a flush never fails for lack of memory
+    int dirtyCount = 0;
+    pthread_mutex_lock(&disk->cacheLock);
+    struct cacheBlock **dirtyBlocks = disk->writebackBlocks;
+    for (int i = 0; i < disk->bufferCacheSize; i++)
+    {
+        if (disk->bufferCache[i].block != -1 && disk->bufferCache[i].dirty)
+        {
+            dirtyBlocks[dirtyCount++] = &(disk->bufferCache[i]);
+        }
+    }
+
+    // Write back in disk order, adjacent blocks in a single call
+    qsort(dirtyBlocks, dirtyCount, sizeof(struct cacheBlock *), compareCacheBlocks);
+    struct iovec blocks[WRITEBACK_VECTOR_MAX];
+    int res = 0;
+    int i = 0;
+    while (i < dirtyCount)
+    {
+        int runLength = 0;
+        while (i + runLength < dirtyCount && runLength < WRITEBACK_VECTOR_MAX && dirtyBlocks[i + runLength]->block == dirtyBlocks[i]->block + runLength)
+        {
+            blocks[runLength].iov_base = dirtyBlocks[i + runLength]->data;
+            blocks[runLength].iov_len = disk->blockSize;
+            runLength++;
+        }
+
+        if (write_block_vector(blocks, dirtyBlocks[i]->block, runLength) == -1)
+        {
+            res = -1;
+        }
+        else
+        {
+            for (int j = i; j < i + runLength; j++)
             {
-                readFromBlockToBuffer(bufferPtr, blockPtr, 0, BLOCKSIZE, &byteCount);
+                dirtyBlocks[j]->dirty = 0;
             }
+            disk->cacheStats.writebacks += runLength;
+        }
+        i += runLength;
+    }
+    pthread_mutex_unlock(&disk->cacheLock);
+    return res;
+}
+
+void copySpan(char *destination, char *source, int length)
+{
+    // Full blocks of the common sizes get a constant size the compiler inlines as an unrolled vector copy
+    if (length == disk->blockSize)
+    {
+        switch (length)
+        {
+        case 2048:
+            memcpy(destination, source, 2048);
+            return;
+        case 4096:
+            memcpy(destination, source, 4096);
+            return;
+        case 8192:
+            memcpy(destination, source, 8192);
+            return;
+        }
+    }
+    memcpy(destination, source, length);
+}
 
-            blockPtr = cachedFatTable[blockPtr].nextBlockIndex;
+int readFromBlockToBuffer(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter)
+{
+    // Copy from the mapping when there is one, the buffer cache otherwise
+    char *blockData;
+    if (disk->mappedDisk != NULL)
+    {
+        blockData = getMappedBlock(block);
+    }
+    else
+    {
+        // The pinned slot can't be evicted while copying out of it
+        struct cacheBlock *entry = getCachedBlock(block, 1);
+        if (entry == NULL)
+        {
+            return -1;
         }
+        copySpan(blockBuffer + *byteCounter, entry->data + startOffset, endOffset - startOffset);
+        releaseCachedBlock(entry);
+        *byteCounter += endOffset - startOffset;
+        return *byteCounter;
     }
 
-    // Increment the file pointer
-    openFileTable[fd].positionPtr = logicalEndOffset;
+    // Copy the whole span at once
+    copySpan(blockBuffer + *byteCounter, blockData + startOffset, endOffset - startOffset);
+    *byteCounter += endOffset - startOffset;
+    return *byteCounter;
+}
 
-    if (byteCount != n)
+int readBlockRunToBuffer(char *blockBuffer, int block, int count)
+{
+    // Read straight into the caller's buffer, bypassing the buffer cache
+    if (read_block_run((void *)blockBuffer, block, count) == -1)
     {
-        printf("ERROR: Could not read n bytes!\n");
         return -1;
     }
 
-    return byteCount;
+    // Cached copies may hold newer data, a copy written back after the read above is clean again by now
+    pthread_mutex_lock(&disk->cacheLock);
+    for (int i = 0; i < count; i++)
+    {
+        struct cacheBlock *entry = findCachedBlock(block + i);
+        if (entry != NULL && !entry->loading)
+        {
+            copySpan(blockBuffer + ((size_t)i << disk->blockShift), entry->data, disk->blockSize);
+        }
+    }
+    pthread_mutex_unlock(&disk->cacheLock);
+
+    return count * disk->blockSize;
 }
 
-int vsappend(int fd, void *buf, int n)
+int writeBufferToBlockRun(char *blockBuffer, int block, int count)
 {
-    // Check correctness of n
-    if (n <= 0)
+    // Drop stale copies so the buffer cache can't shadow the new data
+    for (int i = 0; i < count; i++)
     {
-        printf("ERROR: n can't take a negative value! %d\n", n);
-        return -1;
+        invalidateCachedBlock(block + i);
     }
 
-    // Check if file is opened
-    if (openFileTable[fd].dirBlock == -1)
+    if (write_block_run((void *)blockBuffer, block, count) == -1)
     {
-        printf("ERROR: file must opened first!\n");
         return -1;
     }
 
-    // Check the correct mode
-    if (openFileTable[fd].accessMode == MODE_READ)
+    return count * disk->blockSize;
+}
+
+int writeFromBufferToBlock(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter, int writeSize)
+{
+    // Span ends at the end of the block or of the caller's data, whichever is first
+    int length = endOffset - startOffset;
+    if (length > writeSize - *byteCounter)
     {
-        printf("ERROR: can't append in READ mode!\n");
-        return -1;
+        length = writeSize - *byteCounter;
     }
 
-    // Get cached directory entry of the file
-    struct dirEntry *tmpDirEntry = &(cachedRootDirectory[openFileTable[fd].cachedRootDirIndex]);
-    int size = tmpDirEntry->size;
-
-    // Logical block offset of file for last block
-    int dataBlockOffset = size % BLOCKSIZE;
-    if (size > 0 && size % BLOCKSIZE == 0)
+    if (disk->mappedDisk != NULL)
     {
-        dataBlockOffset = BLOCKSIZE;
+        copySpan(getMappedBlock(block) + startOffset, blockBuffer + *byteCounter, length);
+        markMappedRangeDirty((size_t)block * disk->blockSize, disk->blockSize);
     }
+    else
+    {
+        // Appends starting at offset 0 go to a fresh block, no need to read it
+        struct cacheBlock *entry = getCachedBlock(block, startOffset > 0);
+        if (entry == NULL)
+        {
+            return -1;
+        }
 
-    // Calculate remaining bytes of the last block and required block count for the remaining bytes
-    int remainingByte = BLOCKSIZE - dataBlockOffset;
-    int requiredBlockCount = ((n - remainingByte) / BLOCKSIZE) + 1;
+        // Copy under the lock so write back never sees a half written block
+        pthread_mutex_lock(&disk->cacheLock);
+        copySpan(entry->data + startOffset, blockBuffer + *byteCounter, length);
+        entry->dirty = 1;
+        entry->pinCount--;
+        pthread_mutex_unlock(&disk->cacheLock);
+    }
 
-    // Check if the available bytes in the last block is sufficient
-    if (n <= remainingByte)
+    *byteCounter += length;
+    return *byteCounter;
+}
+
+int findBlockOfFile(int fd, int logicalBlock)
+{
+    struct fileStruct *file = getOpenFile(fd);
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(file->cachedRootDirIndex);
+
+    // Sample i of the skip index is logical block (i + 1) * SKIP_INDEX_INTERVAL, take the closest one below.
+    // Readers sharing the file extend the index, so it is only used under its lock, short walks from the cursor skip it.
+    int sample = logicalBlock / SKIP_INDEX_INTERVAL - 1;
+    int sampled = 0;
+    if (sample >= 0 && (logicalBlock < file->cursorLogicalBlock || (sample + 1) * SKIP_INDEX_INTERVAL > file->cursorLogicalBlock))
     {
-        requiredBlockCount = 0;
+        pthread_mutex_lock(&(tmpDirEntry->indexLock));
+        sample = (sample < tmpDirEntry->skipIndexCount) ? sample : tmpDirEntry->skipIndexCount - 1;
+        if (sample >= 0 && (logicalBlock < file->cursorLogicalBlock || (sample + 1) * SKIP_INDEX_INTERVAL > file->cursorLogicalBlock))
+        {
+            file->cursorLogicalBlock = (sample + 1) * SKIP_INDEX_INTERVAL;
+            file->cursorBlock = tmpDirEntry->skipIndex[sample];
+            sampled = 1;
+        }
+        pthread_mutex_unlock(&(tmpDirEntry->indexLock));
     }
 
-    // Check if enough available blocks exist on the virtual disk
-    if (requiredBlockCount > freeBlockCount)
+    if (!sampled && (logicalBlock < file->cursorLogicalBlock || file->cursorBlock == -1))
     {
-        printf("ERROR: Not enough free blocks available! required: %d  free:%d\n", requiredBlockCount, freeBlockCount);
-        return -1;
+        // Restart from the first block only when moving backwards before the first sample,
+        // or when the descriptor was opened before the file had blocks
+        file->cursorLogicalBlock = 0;
+        file->cursorBlock = tmpDirEntry->startBlock;
     }
 
-    int byteCount = 0;
-    while (byteCount != n)
+    while (file->cursorLogicalBlock < logicalBlock)
     {
-        // Full block write
-        if (dataBlockOffset == BLOCKSIZE)
+        int nextBlock = getFatEntry(file->cursorBlock);
+        if (nextBlock == EOF_FLAG)
         {
-            // Allocate a new block
-            int newAllocatedBlock = allocateAvailableBlockForFile(tmpDirEntry->startBlock);
+            // Keep the cursor on the last block so it stays valid after appends
+            return -1;
+        }
 
-            if (newAllocatedBlock == -1)
-            {
-                printf("ERROR: New block allocation issue!\n");
-                return -1;
-            }
+        file->cursorBlock = nextBlock;
+        file->cursorLogicalBlock++;
 
-            writeFromBufferToBlock((char *)buf, newAllocatedBlock, 0, BLOCKSIZE, &byteCount, n);
-        }
-        // Partial block write
-        else
+        // Samples are taken in order as walks pass them, blocks of a chain never move until it is deleted
+        if (file->cursorLogicalBlock % SKIP_INDEX_INTERVAL == 0)
         {
-            // Get last block of the file
-            int lastBlockOfFile = getLastBlockOfFile(tmpDirEntry->startBlock);
-            writeFromBufferToBlock((char *)buf, lastBlockOfFile, dataBlockOffset, BLOCKSIZE, &byteCount, n);
-
-            // Continue with full block writes
-            dataBlockOffset = BLOCKSIZE;
+            addSkipIndexSample(tmpDirEntry, file->cursorLogicalBlock / SKIP_INDEX_INTERVAL - 1, nextBlock);
         }
     }
 
-    // Modify file size at directory entry both on memory cache and virtual disk
-    allocateDirectoryEntry(openFileTable[fd].cachedRootDirIndex, tmpDirEntry->filename, tmpDirEntry->size + n, tmpDirEntry->startBlock, tmpDirEntry->allocated);
+    return file->cursorBlock;
+}
 
-    if (byteCount != n)
+void addSkipIndexSample(struct dirEntry *tmpDirEntry, int sample, int block)
+{
+    // Only the next missing sample is added, other walks may have taken it already
+    pthread_mutex_lock(&(tmpDirEntry->indexLock));
+    if (sample != tmpDirEntry->skipIndexCount)
     {
-        printf("ERROR: Could not write n bytes!\n");
-        return -1;
+        pthread_mutex_unlock(&(tmpDirEntry->indexLock));
+        return;
     }
 
-    return byteCount;
-}
-
-int vsdelete(char *filename)
-{
-    // Close file descriptor
-    for (int i = 0; i < MAX_NOF_OPEN_FILES; i++)
+    if (tmpDirEntry->skipIndexCount == tmpDirEntry->skipIndexCapacity)
     {
-        if (openFileTable[i].dirBlock > -1 && strcmp(filename, cachedRootDirectory[openFileTable[i].cachedRootDirIndex].filename) == 0)
+        // Without memory the index stops growing, walks still find every block
+        int capacity = (tmpDirEntry->skipIndexCapacity > 0) ? tmpDirEntry->skipIndexCapacity * 2 : 16;
+        int *samples = realloc(tmpDirEntry->skipIndex, (size_t)capacity * sizeof(int));
+        if (samples == NULL)
         {
-            vsclose(i);
+            pthread_mutex_unlock(&(tmpDirEntry->indexLock));
+            return;
         }
+        tmpDirEntry->skipIndex = samples;
+        tmpDirEntry->skipIndexCapacity = capacity;
     }
+    tmpDirEntry->skipIndex[tmpDirEntry->skipIndexCount++] = block;
+    pthread_mutex_unlock(&(tmpDirEntry->indexLock));
+}
 
-    // Find and deallocate root directory of file on disk
-    int directoryIndex = findDirectoryEntryIndexByFilename(filename);
-    deallocateDirectoryEntry(directoryIndex);
+void releaseSkipIndex(struct dirEntry *tmpDirEntry)
+{
+    free(tmpDirEntry->skipIndex);
+    tmpDirEntry->skipIndex = NULL;
+    tmpDirEntry->skipIndexCount = 0;
+    tmpDirEntry->skipIndexCapacity = 0;
+}
 
-    // Check if file has a valid startBlock
-    if (cachedRootDirectory[directoryIndex].startBlock == -1)
+void deallocateFatEntriesOfFile(int startBlock)
+{
+    int traverseBlock = startBlock;
+    pthread_mutex_lock(&disk->allocatorLock);
+    while (traverseBlock != EOF_FLAG)
     {
-        printf("ERROR: Can't find any directory entry associated with the file\n");
-        return -1;
-    }
-
-    // Deallocate all FAT entries of the file
-    deallocateFatEntriesOfFile(cachedRootDirectory[directoryIndex].startBlock);
+        // The page of every block of the chain was loaded to walk it
+        struct fatPage *page = getFatPage(traverseBlock >> disk->fatEntryShift);
+        int entry = traverseBlock & (disk->fatEntriesPerBlock - 1);
+        if (page == NULL)
+        {
+            break;
+        }
 
-    // Decrease file count
-    fileCount--;
-    return (0);
-}
+        // Deallocate FAT entry on memory cache
+        int tmpNextBlock = page->entries[entry];
+        page->entries[entry] = NOT_USED_FLAG;
+        page->pendingFreeBits[entry / BITMAP_WORD_BITS] |= 1ULL << (entry % BITMAP_WORD_BITS);
+        disk->pendingFreeCount++;
+        invalidateCachedBlock(traverseBlock);
 
-// Virtual Disk & Cache Functions
+        // Deallocate FAT entry on virtual disk with the next metadata flush
+        disk->fatBlockDirty[traverseBlock >> disk->fatEntryShift] = 1;
 
-void getSuperblock()
-{
-    char block[BLOCKSIZE];
-    read_block((void *)block, SUPERBLOCK_START);
-    dataBlockCount = ((int *)(block))[0];
-    totalBlockCount = ((int *)(block + 4))[0];
-    freeBlockCount = ((int *)(block + 8))[0];
-    fileCount = ((int *)(block + 12))[0];
+        disk->freeBlockCount++;
+        traverseBlock = tmpNextBlock;
+    }
+    pthread_mutex_unlock(&disk->allocatorLock);
 }
 
-void setSuperblock()
+void deallocateDirectoryEntry(int cacheIndex)
 {
-    char block[BLOCKSIZE];
-    read_block((void *)block, SUPERBLOCK_START);
-    ((int *)(block + 8))[0] = freeBlockCount;
-    ((int *)(block + 12))[0] = fileCount;
-    write_block((void *)block, SUPERBLOCK_START);
+    struct dirEntry *tmpDirEntry = getDirectoryEntry(cacheIndex);
+    pthread_mutex_lock(&disk->directoryLock);
+
+    // Mark directory entry available in memory cache
+    tmpDirEntry->allocated = NOT_USED_FLAG;
+    removeFilenameIndex(cacheIndex);
+
+    // Mark directory entry available in virtual disk with the next metadata flush
+    markDirectoryBlockDirty(cacheIndex / disk->dirEntriesPerBlock);
+    pthread_mutex_unlock(&disk->directoryLock);
 }
 
-void initializeSuperBlock(int blockCount)
+void markDirectoryBlockDirty(int dirBlock)
 {
-    char block[BLOCKSIZE];
-    ((int *)(block))[0] = blockCount - METADATA_BLOCK_SIZE;     // total data block count
-    ((int *)(block + 4))[0] = blockCount;                       // total block count
-    ((int *)(block + 8))[0] = blockCount - METADATA_BLOCK_SIZE; // free blocks
-    ((int *)(block + 12))[0] = 0;                               // number of files
-    write_block((void *)block, SUPERBLOCK_START);
+    if (!disk->rootDirBlockDirty[dirBlock])
+    {
+        disk->rootDirBlockDirty[dirBlock] = 1;
+        disk->rootDirBlockDirtyCount++;
+    }
 }
+// Asynchronous requests
 
-void initializeFatBlocks(int totalBlockCount)
+struct asyncRequest *createAsyncRequest(struct dirEntry *tmpDirEntry, int isWrite, void *userData)
 {
-    char block[BLOCKSIZE];
-    // printf("LOG(initializeFatBlocks): %d\n", totalBlockCount);
-    for (int i = 0; i < FAT_BLOCK_COUNT; i++)
+    struct asyncRequest *request = calloc(1, sizeof(struct asyncRequest));
+    if (request == NULL)
     {
-        for (int j = 0; j < FAT_ENTRY_PER_BLOCK; j++)
-        {
-            if (i * FAT_ENTRY_PER_BLOCK + j < totalBlockCount)
-            {
-                ((int *)(block + j * FAT_ENTRY_SIZE))[0] = NOT_USED_FLAG;
-            }
-            else
-            {
-                // Mark unavailable block numbers inaccessible
-                ((int *)(block + j * FAT_ENTRY_SIZE))[0] = EOF_FLAG;
-            }
-        }
+        return NULL;
+    }
+    request->userData = userData;
+    request->isWrite = isWrite;
+    request->file = tmpDirEntry;
+    request->pendingOperations = 1;
 
-        write_block((void *)block, FAT_BLOCK_START + i);
+    pthread_mutex_lock(&disk->asyncLock);
+    if (disk->asyncBackend == -1 && startAsyncBackend() == -1)
+    {
+        pthread_mutex_unlock(&disk->asyncLock);
+        free(request);
+        printf("ERROR: Could not start the asynchronous backend!\n");
+        return NULL;
     }
 
-    // Mark meta data blocks as allocated
-    read_block((void *)block, FAT_BLOCK_START);
-    for (int i = 0; i < METADATA_BLOCK_SIZE; i++)
+    // The file can't be deleted until the request completes
+    disk->asyncRequestsInFlight++;
+    __atomic_add_fetch(&(tmpDirEntry->asyncCount), 1, __ATOMIC_SEQ_CST);
+    if (isWrite)
     {
-        ((int *)(block + i * FAT_ENTRY_SIZE))[0] = EOF_FLAG;
+        __atomic_add_fetch(&(tmpDirEntry->asyncWriteCount), 1, __ATOMIC_SEQ_CST);
     }
-    write_block((void *)block, FAT_BLOCK_START);
+    pthread_mutex_unlock(&disk->asyncLock);
+    return request;
 }
 
-void initializeRootDirectoryBlocks()
+int finishAsyncRequest(struct asyncRequest *request, int result)
 {
-    char block[BLOCKSIZE];
-    int allocationStatusOffset = (MAX_FILENAME_LENGTH + 8);
-    for (int i = 0; i < DIR_ENTRY_PER_BLOCK; i++)
+    pthread_mutex_lock(&disk->asyncLock);
+    if (result == -1 && request->submittedOperations == 0)
     {
-        // Mark root directories not used
-        ((int *)(block + (i * DIR_ENTRY_SIZE) + allocationStatusOffset))[0] = NOT_USED_FLAG;
+        // Nothing reached the backend, the caller gets the failure instead of a completion
+        request->pendingOperations = 0;
+        request->failed = 1;
+        releaseAsyncRequest(request);
+        pthread_mutex_unlock(&disk->asyncLock);
+        free(request);
+        return -1;
     }
 
-    // Write to the disk the root directory information
-    for (int i = 0; i < ROOT_DIR_COUNT; i++)
+    // Runs submitted before a failure still complete, the request reports it
+    request->result = result;
+    request->failed |= (result == -1);
+    if (--request->pendingOperations == 0)
     {
-        write_block((void *)block, ROOT_DIR_START + i);
+        releaseAsyncRequest(request);
+        postAsyncRequest(request);
     }
+    pthread_mutex_unlock(&disk->asyncLock);
+    return (0);
 }
 
-void cacheFatTable()
+void releaseAsyncRequest(struct asyncRequest *request)
 {
-    char block[BLOCKSIZE];
-
-    for (int i = 0; i < FAT_BLOCK_COUNT; i++)
+    disk->asyncRequestsInFlight--;
+    __atomic_sub_fetch(&(request->file->asyncCount), 1, __ATOMIC_SEQ_CST);
+    if (request->isWrite)
     {
-        read_block((void *)block, FAT_BLOCK_START + i);
-
-        for (int j = 0; j < FAT_ENTRY_PER_BLOCK; j++)
-        {
-            struct fatEntry *tmpFatEntry = &(cachedFatTable[i * FAT_ENTRY_PER_BLOCK + j]);
-            int entryStartOffsetBytes = j * FAT_ENTRY_SIZE;
-            tmpFatEntry->nextBlockIndex = ((int *)(block + entryStartOffsetBytes))[0];
-        }
+        __atomic_sub_fetch(&(request->file->asyncWriteCount), 1, __ATOMIC_SEQ_CST);
     }
+    pthread_cond_broadcast(&disk->asyncDone);
 }
 
-void cacheRootDirectory()
+void postAsyncRequest(struct asyncRequest *request)
 {
-    char block[BLOCKSIZE];
-
-    for (int i = 0; i < ROOT_DIR_COUNT; i++)
+    request->result = request->failed ? -1 : request->result;
+    request->next = NULL;
+    if (disk->asyncReadyTail != NULL)
     {
-        read_block((void *)block, ROOT_DIR_START + i);
-        for (int j = 0; j < DIR_ENTRY_PER_BLOCK; j++)
-        {
-            struct dirEntry *tmpDirEntry = &(cachedRootDirectory[i * DIR_ENTRY_PER_BLOCK + j]);
-            int entryStartOffset = j * DIR_ENTRY_SIZE;
-            memcpy(tmpDirEntry->filename, (char *)(block + entryStartOffset), MAX_FILENAME_LENGTH);
-            tmpDirEntry->size = ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH))[0];
-            tmpDirEntry->startBlock = ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH + 4))[0];
-            tmpDirEntry->allocated = ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH + 8))[0];
-        }
+        disk->asyncReadyTail->next = request;
+    }
+    else
+    {
+        disk->asyncReadyHead = request;
     }
+    disk->asyncReadyTail = request;
+    disk->asyncReadyCount++;
 }
 
-void flushCachedFatTable()
+int submitAsyncOperation(struct asyncRequest *request, char *buffer, int block, int count, char *copyTo, int copyOffset, int copyLength)
 {
-    char block[BLOCKSIZE];
+    struct asyncOperation *operation = malloc(sizeof(struct asyncOperation));
+    if (operation == NULL)
+    {
+        return -1;
+    }
 
-    for (int i = 0; i < FAT_BLOCK_COUNT; i++)
+    // A span of a block is read whole into a block of its own
+    if (copyTo != NULL)
     {
-        for (int j = 0; j < FAT_ENTRY_PER_BLOCK; j++)
+        buffer = malloc(disk->blockSize);
+        if (buffer == NULL)
         {
-            struct fatEntry *tmpFatEntry = &(cachedFatTable[i * FAT_ENTRY_PER_BLOCK + j]);
-            int entryStartOffset = j * FAT_ENTRY_SIZE;
-            ((int *)(block + entryStartOffset))[0] = tmpFatEntry->nextBlockIndex;
+            free(operation);
+            return -1;
         }
-        write_block((void *)block, FAT_BLOCK_START + i);
     }
-}
+    operation->request = request;
+    operation->buffer = buffer;
+    operation->block = block;
+    operation->count = count;
+    operation->copyTo = copyTo;
+    operation->copyOffset = copyOffset;
+    operation->copyLength = copyLength;
+    operation->next = NULL;
+
+    // Written blocks can't be shadowed by stale cached copies
+    for (int i = 0; request->isWrite && i < count; i++)
+    {
+        invalidateCachedBlock(block + i);
+    }
 
-void flushCachedRootDirectory()
-{
-    char block[BLOCKSIZE];
+    // The mapping is copied right away, there is nothing to wait for
+    int res = (disk->mappedDisk != NULL) ? mapped_io(buffer, block, (size_t)count << disk->blockShift, request->isWrite) : 0;
 
-    for (int i = 0; i < ROOT_DIR_COUNT; i++)
+    pthread_mutex_lock(&disk->asyncLock);
+    request->pendingOperations++;
+    request->submittedOperations++;
+    disk->asyncOperationsInFlight++;
+    disk->asyncWritesInFlight += request->isWrite;
+    if (disk->mappedDisk != NULL)
+    {
+        completeAsyncOperation(operation, res);
+    }
+    else if (disk->asyncBackend == ASYNC_IO_URING)
     {
-        for (int j = 0; j < DIR_ENTRY_PER_BLOCK; j++)
+        if (queueRingOperation(operation) == -1)
+        {
+            completeAsyncOperation(operation, -1);
+        }
+    }
+    else
+    {
+        if (disk->asyncQueueTail != NULL)
+        {
+            disk->asyncQueueTail->next = operation;
+        }
+        else
         {
-            struct dirEntry *tmpDirEntry = &(cachedRootDirectory[i * DIR_ENTRY_PER_BLOCK + j]);
-            int entryStartOffset = j * DIR_ENTRY_SIZE;
-            memcpy((char *)(block + entryStartOffset), tmpDirEntry->filename, MAX_FILENAME_LENGTH);
-            ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH))[0] = tmpDirEntry->size;
-            ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH + 4))[0] = tmpDirEntry->startBlock;
-            ((int *)(block + entryStartOffset + MAX_FILENAME_LENGTH + 8))[0] = tmpDirEntry->allocated;
+            disk->asyncQueueHead = operation;
         }
-        write_block((void *)block, ROOT_DIR_START + i);
+        disk->asyncQueueTail = operation;
+        pthread_cond_signal(&disk->asyncWork);
     }
+    pthread_mutex_unlock(&disk->asyncLock);
+    return (0);
 }
 
-void clearOpenFileTable()
+void completeAsyncOperation(struct asyncOperation *operation, int res)
 {
-    for (int i = 0; i < MAX_NOF_OPEN_FILES; i++)
+    struct asyncRequest *request = operation->request;
+    if (res == -1)
+    {
+        request->failed = 1;
+    }
+    else if (operation->copyTo != NULL)
+    {
+        memcpy(operation->copyTo, operation->buffer + operation->copyOffset, operation->copyLength);
+    }
+    if (operation->copyTo != NULL)
+    {
+        free(operation->buffer);
+    }
+
+    disk->asyncOperationsInFlight--;
+    disk->asyncWritesInFlight -= request->isWrite;
+    free(operation);
+    if (--request->pendingOperations == 0)
     {
-        openFileTable[i].dirBlock = -1;
-        openFileCount = 0;
+        releaseAsyncRequest(request);
+        postAsyncRequest(request);
     }
+    pthread_cond_broadcast(&disk->asyncDone);
 }
 
-int findAvailableDirectoryEntryIndex()
+int reapAsyncCompletions()
 {
-    int cacheIndex;
-    for (int i = 0; i < ROOT_DIR_COUNT; i++)
+#ifdef HAVE_IO_URING
+    if (disk->asyncBackend != ASYNC_IO_URING)
+    {
+        return (0);
+    }
+
+    // Runs finish in any order, each completion names its run
+    unsigned int head = *disk->asyncRing.cqHead;
+    unsigned int tail = __atomic_load_n(disk->asyncRing.cqTail, __ATOMIC_ACQUIRE);
+    int reaped = 0;
+    while (head != tail)
     {
-        for (int j = 0; j < DIR_ENTRY_PER_BLOCK; j++)
+        struct io_uring_cqe *cqe = &(disk->asyncRing.cqes[head & *disk->asyncRing.cqMask]);
+        struct asyncOperation *operation = (struct asyncOperation *)(unsigned long)cqe->user_data;
+        int length = operation->count << disk->blockShift;
+        int res = (cqe->res == length) ? 0 : -1;
+        head++;
+        disk->asyncRing.inFlight--;
+        reaped++;
+
+        if (res == 0 && operation->request->isWrite)
         {
-            cacheIndex = i * DIR_ENTRY_PER_BLOCK + j;
-            if (cachedRootDirectory[cacheIndex].allocated == NOT_USED_FLAG)
-            {
-                return cacheIndex;
-            }
+            __atomic_add_fetch(&disk->ioStats.writeCalls, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&disk->ioStats.bytesWritten, length, __ATOMIC_RELAXED);
         }
+        else if (res == 0)
+        {
+            __atomic_add_fetch(&disk->ioStats.readCalls, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&disk->ioStats.bytesRead, length, __ATOMIC_RELAXED);
+        }
+        completeAsyncOperation(operation, res);
     }
-
-    // If not empty entry found
-    return -1;
+    __atomic_store_n(disk->asyncRing.cqHead, head, __ATOMIC_RELEASE);
+    return reaped;
+#else
+    return (0);
+#endif
 }
 
-int findDirectoryEntryIndexByFilename(char *filename)
+void waitAsyncProgress()
 {
-    for (int i = 0; i < DIR_ENTRY_COUNT; i++)
+#ifdef HAVE_IO_URING
+    // Completions are reaped by whoever waits, the lock keeps it to one thread at a time
+    if (disk->asyncBackend == ASYNC_IO_URING && disk->asyncRing.inFlight > 0)
     {
-        if (cachedRootDirectory[i].allocated == USED_FLAG && strcmp(filename, cachedRootDirectory[i].filename) == 0)
+        if (reapAsyncCompletions() == 0)
         {
-            return i;
+            syscall(__NR_io_uring_enter, disk->asyncRing.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            reapAsyncCompletions();
         }
+        return;
     }
+#endif
 
-    // Could not be found
-    return -1;
+    // Pool threads, and requests still being submitted, signal when they are done
+    pthread_cond_wait(&disk->asyncDone, &disk->asyncLock);
 }
 
-int findAvailableBlockIndex()
+void waitForAsyncWrites(struct dirEntry *tmpDirEntry)
 {
-    int cacheIndex;
-    for (int i = 0; i < FAT_BLOCK_COUNT; i++)
+    // Cheap check first, most files never see an asynchronous append
+    if (tmpDirEntry != NULL && __atomic_load_n(&(tmpDirEntry->asyncWriteCount), __ATOMIC_SEQ_CST) == 0)
     {
-        for (int j = 0; j < FAT_ENTRY_PER_BLOCK; j++)
-        {
-            cacheIndex = i * FAT_ENTRY_PER_BLOCK + j;
-            if (cachedFatTable[cacheIndex].nextBlockIndex == NOT_USED_FLAG)
-            {
-                return cacheIndex;
-            }
-        }
+        return;
     }
 
-    // If not empty entry found
-    return -1;
+    pthread_mutex_lock(&disk->asyncLock);
+    while ((tmpDirEntry != NULL) ? __atomic_load_n(&(tmpDirEntry->asyncWriteCount), __ATOMIC_SEQ_CST) > 0 : disk->asyncWritesInFlight > 0)
+    {
+        waitAsyncProgress();
+    }
+    pthread_mutex_unlock(&disk->asyncLock);
 }
 
-int findAvailableOpenFileTableIndex()
+int queueRingOperation(struct asyncOperation *operation)
 {
-    for (int i = 0; i < MAX_NOF_OPEN_FILES; i++)
+#ifdef HAVE_IO_URING
+    // Completions never outnumber the ring, so none are dropped
+    while (disk->asyncRing.inFlight == disk->asyncRing.entries)
     {
-        if (openFileTable[i].dirBlock == -1)
-        {
-            return i;
-        }
+        waitAsyncProgress();
     }
 
+    unsigned int tail = *disk->asyncRing.sqTail;
+    unsigned int index = tail & *disk->asyncRing.sqMask;
+    struct io_uring_sqe *sqe = &(disk->asyncRing.sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = operation->request->isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = disk->vs_fd;
+    sqe->addr = (unsigned long)operation->buffer;
+    sqe->len = operation->count << disk->blockShift;
+    sqe->off = (unsigned long long)operation->block << disk->blockShift;
+    sqe->user_data = (unsigned long)operation;
+    disk->asyncRing.sqArray[index] = index;
+    __atomic_store_n(disk->asyncRing.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    // The kernel only takes entries while entering, one that was not taken is withdrawn
+    int submitted;
+    do
+    {
+        submitted = syscall(__NR_io_uring_enter, disk->asyncRing.fd, 1, 0, 0, NULL, 0);
+    } while (submitted == -1 && errno == EINTR);
+    if (submitted != 1)
+    {
+        __atomic_store_n(disk->asyncRing.sqTail, tail, __ATOMIC_RELEASE);
+        return -1;
+    }
+    disk->asyncRing.inFlight++;
+    return (0);
+#else
     return -1;
+#endif
 }
 
-int allocateBlockFatEntry(int cacheIndex, int data)
-{
-    // Allocate the FAT Entry on memory cache
-    cachedFatTable[cacheIndex].nextBlockIndex = data;
-
-    // Allocate the FAT Entry on virtual disk
-    int fatBlock = cacheIndex / FAT_ENTRY_PER_BLOCK;
-    int fatBlockOffset = cacheIndex % FAT_ENTRY_PER_BLOCK;
-    char block[BLOCKSIZE];
-    read_block((void *)block, FAT_BLOCK_START + fatBlock);
-    ((int *)(block + fatBlockOffset * FAT_ENTRY_SIZE))[0] = data;
-    write_block((void *)block, FAT_BLOCK_START + fatBlock);
-
-    // printf("LOG(allocateBlockFatEntry) (block no: %d) free block count: %d\n", cacheIndex, free_block_count);
-    return cacheIndex;
-};
-
-int allocateAvailableBlockForFile(int startBlock)
+int setupAsyncRing()
 {
-    int lastBlock = getLastBlockOfFile(startBlock);
-    int newBlock = findAvailableBlockIndex();
-
-    if (newBlock == -1)
+#ifdef HAVE_IO_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    disk->asyncRing.fd = syscall(__NR_io_uring_setup, ASYNC_RING_ENTRIES, &params);
+    if (disk->asyncRing.fd < 0)
     {
-        printf("ERROR: Block can not be allocated!\n");
         return -1;
     }
 
-    // Allocate new block
-    allocateBlockFatEntry(newBlock, EOF_FLAG);
-
-    // Decrement free block count
-    freeBlockCount--;
-
-    // Allocate new blocks addres to last blocks value
-    allocateBlockFatEntry(lastBlock, newBlock);
-
-    // printf("LOG(allocateAvailableBlockForFile) last block: %d new block: %d free block: %d\n", lastBlock, newBlock, freeBlockCount);
-
-    return newBlock;
-};
-
-int allocateDirectoryEntry(int cacheIndex, char *filename, int size, int startBlock, int allocationStatus)
-{
-    // Allocate entry on cachedRootDirectory
-    memcpy(cachedRootDirectory[cacheIndex].filename, filename, MAX_FILENAME_LENGTH);
-    cachedRootDirectory[cacheIndex].size = size;
-    cachedRootDirectory[cacheIndex].startBlock = startBlock;
-    cachedRootDirectory[cacheIndex].allocated = allocationStatus;
-
-    // Allocation entry on virtual disk Directory Root
-    int availableEntryBlock = cacheIndex / DIR_ENTRY_PER_BLOCK;
-    int availableEntryBlockOffset = cacheIndex % DIR_ENTRY_PER_BLOCK;
-    char block[BLOCKSIZE];
-    read_block((void *)block, availableEntryBlock + ROOT_DIR_START);
-    int emptyBlockOffsetBytes = availableEntryBlockOffset * DIR_ENTRY_SIZE;
-    memcpy(((char *)(block + emptyBlockOffsetBytes)), filename, MAX_FILENAME_LENGTH);
-    ((int *)(block + emptyBlockOffsetBytes + MAX_FILENAME_LENGTH))[0] = size;                   // size of the file
-    ((int *)(block + emptyBlockOffsetBytes + (MAX_FILENAME_LENGTH + 4)))[0] = startBlock;       // startBlock
-    ((int *)(block + emptyBlockOffsetBytes + (MAX_FILENAME_LENGTH + 8)))[0] = allocationStatus; // mark as used
-
-    int res = write_block((void *)block, availableEntryBlock + ROOT_DIR_START);
-    if (res == -1)
+    disk->asyncRing.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    disk->asyncRing.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    disk->asyncRing.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    disk->asyncRing.sqRing = mmap(NULL, disk->asyncRing.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, disk->asyncRing.fd, IORING_OFF_SQ_RING);
+    disk->asyncRing.cqRing = mmap(NULL, disk->asyncRing.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, disk->asyncRing.fd, IORING_OFF_CQ_RING);
+    disk->asyncRing.sqes = mmap(NULL, disk->asyncRing.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, disk->asyncRing.fd, IORING_OFF_SQES);
+    if (disk->asyncRing.sqRing == MAP_FAILED || disk->asyncRing.cqRing == MAP_FAILED || disk->asyncRing.sqes == MAP_FAILED)
     {
-        printf("ERROR: Write issue!\n");
+        destroyAsyncRing();
         return -1;
     }
 
-    return cacheIndex;
+    disk->asyncRing.entries = params.sq_entries;
+    disk->asyncRing.inFlight = 0;
+    disk->asyncRing.sqTail = (unsigned int *)((char *)disk->asyncRing.sqRing + params.sq_off.tail);
+    disk->asyncRing.sqMask = (unsigned int *)((char *)disk->asyncRing.sqRing + params.sq_off.ring_mask);
+    disk->asyncRing.sqArray = (unsigned int *)((char *)disk->asyncRing.sqRing + params.sq_off.array);
+    disk->asyncRing.cqHead = (unsigned int *)((char *)disk->asyncRing.cqRing + params.cq_off.head);
+    disk->asyncRing.cqTail = (unsigned int *)((char *)disk->asyncRing.cqRing + params.cq_off.tail);
+    disk->asyncRing.cqMask = (unsigned int *)((char *)disk->asyncRing.cqRing + params.cq_off.ring_mask);
+    disk->asyncRing.cqes = (struct io_uring_cqe *)((char *)disk->asyncRing.cqRing + params.cq_off.cqes);
+    return (0);
+#else
+    return -1;
+#endif
 }
 
-void allocateOpenFileTableEntry(int fd, int cacheIndex, int accessMode)
+void destroyAsyncRing()
 {
-    openFileTable[fd].dirBlock = cacheIndex / DIR_ENTRY_PER_BLOCK;
-    openFileTable[fd].dirBlockOffset = cacheIndex % DIR_ENTRY_PER_BLOCK;
-    openFileTable[fd].accessMode = accessMode;
-    openFileTable[fd].positionPtr = 0;
-    openFileTable[fd].cachedRootDirIndex = cacheIndex;
-    openFileCount++;
+#ifdef HAVE_IO_URING
+    if (disk->asyncRing.sqRing != NULL && disk->asyncRing.sqRing != MAP_FAILED)
+    {
+        munmap(disk->asyncRing.sqRing, disk->asyncRing.sqRingSize);
+    }
+    if (disk->asyncRing.cqRing != NULL && disk->asyncRing.cqRing != MAP_FAILED)
+    {
+        munmap(disk->asyncRing.cqRing, disk->asyncRing.cqRingSize);
+    }
+    if (disk->asyncRing.sqes != NULL && (void *)disk->asyncRing.sqes != MAP_FAILED)
+    {
+        munmap(disk->asyncRing.sqes, disk->asyncRing.sqesSize);
+    }
+    close(disk->asyncRing.fd);
+    memset(&disk->asyncRing, 0, sizeof(disk->asyncRing));
+#endif
 }
 
-int readFromBlockToBuffer(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter)
+int startAsyncBackend()
 {
-    char blockData[BLOCKSIZE];
-    read_block((void *)blockData, block);
-    for (int i = startOffset; i < endOffset; i++)
+    if (disk->asyncBackendSetting == ASYNC_IO_URING && setupAsyncRing() == 0)
+    {
+        disk->asyncBackend = ASYNC_IO_URING;
+        return (0);
+    }
+    if (disk->asyncBackendSetting == ASYNC_IO_URING)
     {
-        ((char *)(blockBuffer + *byteCounter))[0] = ((char *)(blockData + i))[0];
-        (*byteCounter)++;
+        printf("WARNING: Could not set up io_uring, using a thread pool!\n");
     }
 
-    return *byteCounter;
+    // The pool runs with the threads that could be started
+    disk->asyncStopping = 0;
+    disk->asyncThreadCount = 0;
+    while (disk->asyncThreadCount < ASYNC_THREAD_COUNT && pthread_create(&disk->asyncThreads[disk->asyncThreadCount], NULL, asyncThreadMain, disk) == 0)
+    {
+        disk->asyncThreadCount++;
+    }
+    if (disk->asyncThreadCount == 0)
+    {
+        return -1;
+    }
+    disk->asyncBackend = ASYNC_THREAD_POOL;
+    return (0);
 }
 
-int writeFromBufferToBlock(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter, int writeSize)
+void stopAsyncBackend()
 {
-    char blockData[BLOCKSIZE];
-    read_block((void *)blockData, block);
-    for (int i = startOffset; i < endOffset; i++)
+    pthread_mutex_lock(&disk->asyncLock);
+    while (disk->asyncOperationsInFlight > 0)
     {
-        ((char *)(blockData + i))[0] = ((char *)(blockBuffer + *byteCounter))[0];
-        (*byteCounter)++;
+        waitAsyncProgress();
+    }
 
-        if (*byteCounter == writeSize)
+    if (disk->asyncBackend == ASYNC_THREAD_POOL)
+    {
+        disk->asyncStopping = 1;
+        pthread_cond_broadcast(&disk->asyncWork);
+        pthread_mutex_unlock(&disk->asyncLock);
+        for (int i = 0; i < disk->asyncThreadCount; i++)
         {
-            // Early termination (found)
-            write_block((void *)blockData, block);
-            return *byteCounter;
+            pthread_join(disk->asyncThreads[i], NULL);
         }
+        pthread_mutex_lock(&disk->asyncLock);
     }
-    write_block((void *)blockData, block);
-    return *byteCounter;
+    else if (disk->asyncBackend == ASYNC_IO_URING)
+    {
+        destroyAsyncRing();
+    }
+    disk->asyncBackend = -1;
+
+    while (disk->asyncReadyHead != NULL)
+    {
+        struct asyncRequest *request = disk->asyncReadyHead;
+        disk->asyncReadyHead = request->next;
+        free(request);
+    }
+    disk->asyncReadyTail = NULL;
+    disk->asyncReadyCount = 0;
+    pthread_mutex_unlock(&disk->asyncLock);
 }
 
-void setRootDirectoryEntry(int fd)
+void *asyncThreadMain(void *arg)
 {
-    char block[BLOCKSIZE];
-    // Get the directory entry for file
-    read_block((void *)block, openFileTable[fd].dirBlock + ROOT_DIR_START);
-    int byteBlockOffset = openFileTable[fd].dirBlockOffset * DIR_ENTRY_SIZE;
-
-    // Get cached root dir entry
-    struct dirEntry *tmpDirEntry = &(cachedRootDirectory[openFileTable[fd].cachedRootDirIndex]);
-
-    ((int *)(block + byteBlockOffset + MAX_FILENAME_LENGTH))[0] = tmpDirEntry->size;
-    ((int *)(block + byteBlockOffset + (MAX_FILENAME_LENGTH + 4)))[0] = tmpDirEntry->startBlock;
-    ((int *)(block + byteBlockOffset + (MAX_FILENAME_LENGTH + 8)))[0] = USED_FLAG;
+    disk = arg;
+    pthread_mutex_lock(&disk->asyncLock);
+    while (1)
+    {
+        while (disk->asyncQueueHead == NULL && !disk->asyncStopping)
+        {
+            pthread_cond_wait(&disk->asyncWork, &disk->asyncLock);
+        }
+        if (disk->asyncQueueHead == NULL)
+        {
+            break;
+        }
 
-    write_block((void *)block, openFileTable[fd].dirBlock + ROOT_DIR_START);
-};
+        struct asyncOperation *operation = disk->asyncQueueHead;
+        disk->asyncQueueHead = operation->next;
+        disk->asyncQueueTail = (disk->asyncQueueHead != NULL) ? disk->asyncQueueTail : NULL;
 
-int getLastBlockOfFile(int startBlock)
-{
-    int traverseBlock = startBlock;
-    while (cachedFatTable[traverseBlock].nextBlockIndex != EOF_FLAG)
-    {
-        traverseBlock = cachedFatTable[traverseBlock].nextBlockIndex;
+        // Each thread has one run on the disk at a time
+        pthread_mutex_unlock(&disk->asyncLock);
+        int res = operation->request->isWrite ? write_block_run(operation->buffer, operation->block, operation->count)
+                                              : read_block_run(operation->buffer, operation->block, operation->count);
+        pthread_mutex_lock(&disk->asyncLock);
+        completeAsyncOperation(operation, res);
     }
-
-    return traverseBlock;
+    pthread_mutex_unlock(&disk->asyncLock);
+    return NULL;
 }
 
-void deallocateFatEntriesOfFile(int startBlock)
+int copyCachedSpan(char *destination, int block, int startOffset, int length)
 {
-    int traverseBlock = startBlock;
-    int fatBlock;
-    int fatBlockOffset;
-    while (traverseBlock != EOF_FLAG)
+    // A slot still loading is read from the disk, which holds the same data
+    pthread_mutex_lock(&disk->cacheLock);
+    struct cacheBlock *entry = findCachedBlock(block);
+    if (entry == NULL || entry->loading)
     {
-        // Deallocate FAT entry on memory cache
-        int tmpNextBlock = cachedFatTable[traverseBlock].nextBlockIndex;
-        cachedFatTable[traverseBlock].nextBlockIndex = NOT_USED_FLAG;
-
-        // Deallocate FAT entry on virtual disk
-        fatBlock = traverseBlock / FAT_ENTRY_PER_BLOCK;
-        fatBlockOffset = traverseBlock % FAT_ENTRY_PER_BLOCK;
-        char block[BLOCKSIZE];
-        read_block((void *)block, FAT_BLOCK_START + fatBlock);
-        ((int *)(block + FAT_ENTRY_SIZE * fatBlockOffset))[0] = NOT_USED_FLAG;
-        write_block((void *)block, FAT_BLOCK_START + fatBlock);
-
-        freeBlockCount++;
-        traverseBlock = tmpNextBlock;
+        pthread_mutex_unlock(&disk->cacheLock);
+        return -1;
     }
+    disk->cacheStats.hits++;
+    copySpan(destination, entry->data + startOffset, length);
+    pthread_mutex_unlock(&disk->cacheLock);
+    return (0);
 }
-
-void deallocateDirectoryEntry(int cacheIndex)
-{
-    char block[BLOCKSIZE];
-    struct dirEntry *tmpDirEntry = &(cachedRootDirectory[cacheIndex]);
-
-    // Mark directory entry available in memory cache
-    tmpDirEntry->allocated = NOT_USED_FLAG;
-
-    int dirBlock = cacheIndex / DIR_ENTRY_PER_BLOCK;
-    int dirBlockOffset = cacheIndex % DIR_ENTRY_PER_BLOCK;
-
-    // Mark directory entry available in virtual disk
-    read_block((void *)block, ROOT_DIR_START + dirBlock);
-    ((int *)(block + dirBlockOffset * DIR_ENTRY_SIZE + (MAX_FILENAME_LENGTH + 8)))[0] = NOT_USED_FLAG;
-    write_block((void *)block, ROOT_DIR_START + dirBlock);
-}
\ No newline at end of file
@@ -1,39 +1,116 @@
+#include <sys/uio.h>
+
 #define MODE_READ 0
 #define MODE_APPEND 1
-#define BLOCKSIZE 2048 // bytes
+#define MOUNT_FD 0   // Access the virtual disk with pread/pwrite through the buffer cache
+#define MOUNT_MMAP 1 // Map the whole virtual disk into memory
+#define FORMAT_SPARSE 0      // Size the virtual disk without writing its data blocks
+#define FORMAT_PREALLOCATE 1 // Reserve every block of the virtual disk on the host file system
+#define FLUSH_IMMEDIATE 0 // Write changed metadata blocks after every call
+#define FLUSH_ON_CLOSE 1  // Write changed metadata blocks on vsclose, vssync and vsumount
+#define FLUSH_PERIODIC 2  // Write back data and metadata from a background thread
+#define FLUSH_ON_SYNC 3   // Write changed metadata blocks on vssync and vsumount only
+#define TYPE_FILE 0      // Entry holds data blocks
+#define TYPE_DIRECTORY 1 // Entry holds other entries
+#define ASYNC_IO_URING 0    // Submit asynchronous requests to an io_uring, falls back to the pool where unavailable
+#define ASYNC_THREAD_POOL 1 // Run asynchronous requests on worker threads with pread/pwrite
+#define BLOCKSIZE 2048       // bytes, block size of vsformat, vsformatmode takes any power of two in between these
+#define MIN_BLOCK_SIZE 512   // bytes
+#define MAX_BLOCK_SIZE 65536 // bytes
+
+struct vsDirent
+{
+    char name[31]; // Last path component, NUL terminated
+    int type;      // TYPE_FILE or TYPE_DIRECTORY
+    int size;      // Bytes, 0 for directories
+};
+
+struct vsCacheStats
+{
+    long hits;       // Lookups served from the buffer cache
+    long misses;     // Lookups that needed a slot
+    long evictions;  // Slots reused for another block
+    long writebacks; // Dirty blocks written to the virtual disk
+};
+
+struct vsIoStats
+{
+    long readCalls;         // Read system calls on the virtual disk
+    long writeCalls;        // Write system calls on the virtual disk
+    long long bytesRead;    // Bytes read from the virtual disk
+    long long bytesWritten; // Bytes written to the virtual disk
+};
+
+struct vsCompletion
+{
+    void *userData; // As passed to vsreadasync or vsappendasync
+    int result;     // Bytes read or appended, -1 on error
+};
+
+// A virtual disk mounted with vsfsmount, the vs* calls use one shared disk
+typedef struct vsfs vsfs_t;
 
+// Disks of 2^m bytes, m from 18 to 46, with at most 2^30 blocks so larger disks need larger blocks
 int vsformat(char *vdiskname, unsigned int m);
+int vsformatmode(char *vdiskname, unsigned int m, int formatMode, int blockSize);
 int vsmount(char *vdiskname);
+int vsmountmode(char *vdiskname, int mountMode);
 int vsumount();
 int vscreate(char *filename);
 int vsopen(char *filename, int mode);
 int vsclose(int fd);
 int vssize(int fd);
 int vsread(int fd, void *buf, int n);
+int vspread(int fd, void *buf, int n, int offset);
+int vsseek(int fd, int offset);
+int vsreadview(int fd, int n, struct iovec **iov, int *cnt);
+int vsreleaseview(int fd);
 int vsappend(int fd, void *buf, int n);
+int vsreadasync(int fd, void *buf, int n, int offset, void *userData);
+int vsappendasync(int fd, void *buf, int n, void *userData);
+int vspoll(struct vsCompletion *completions, int maxCompletions);
+int vswait(struct vsCompletion *completions, int maxCompletions, int minCompletions);
+int vssetasyncbackend(int backend);
+int vsgetasyncbackend();
+vsfs_t *vsfsmount(char *vdiskname, int mountMode);
+int vsfsumount(vsfs_t *fs);
+int vsfscreate(vsfs_t *fs, char *filename);
+int vsfsopen(vsfs_t *fs, char *filename, int mode);
+int vsfsclose(vsfs_t *fs, int fd);
+int vsfssize(vsfs_t *fs, int fd);
+int vsfsread(vsfs_t *fs, int fd, void *buf, int n);
+int vsfspread(vsfs_t *fs, int fd, void *buf, int n, int offset);
+int vsfsseek(vsfs_t *fs, int fd, int offset);
+int vsfsreadview(vsfs_t *fs, int fd, int n, struct iovec **iov, int *cnt);
+int vsfsreleaseview(vsfs_t *fs, int fd);
+int vsfsappend(vsfs_t *fs, int fd, void *buf, int n);
+int vsfsreadasync(vsfs_t *fs, int fd, void *buf, int n, int offset, void *userData);
+int vsfsappendasync(vsfs_t *fs, int fd, void *buf, int n, void *userData);
+int vsfspoll(vsfs_t *fs, struct vsCompletion *completions, int maxCompletions);
+int vsfswait(vsfs_t *fs, struct vsCompletion *completions, int maxCompletions, int minCompletions);
+int vsfsdelete(vsfs_t *fs, char *filename);
+int vsfsmkdir(vsfs_t *fs, char *dirname);
+int vsfsrmdir(vsfs_t *fs, char *dirname);
+int vsfsreaddir(vsfs_t *fs, char *dirname, struct vsDirent *entries, int maxEntries);
+int vsfssync(vsfs_t *fs);
+int vsfsgetblocksize(vsfs_t *fs);
+void vsfsgetiostats(vsfs_t *fs, struct vsIoStats *stats);
+void vsfsresetstats(vsfs_t *fs);
+void vsfsgetcachestats(vsfs_t *fs, struct vsCacheStats *stats);
+int vsfssetflushpolicy(vsfs_t *fs, int policy, int intervalMs);
+int vsfssetallocationwindow(vsfs_t *fs, int blockCount);
+void vsfsfragreport(vsfs_t *fs);
+int vsfsgetasyncbackend(vsfs_t *fs);
 int vsdelete(char *filename);
-void initializeSuperBlock(int blockCount);
-void initializeFatBlocks();
-void initializeRootDirectoryBlocks();
-void cacheFatTable();
-void cacheRootDirectory();
-void flushCachedFatTable();
-void flushCachedRootDirectory();
-void clearOpenFileTable();
-void getSuperblock();
-void setSuperblock();
-void setRootDirectoryEntry(int fd);
-int allocateBlockFatEntry(int cacheIndex, int data);
-int allocateAndAppendAvailableBlock(int startBlock);
-int getLastBlockOfFile(int startBlock);
-void deallocateFatEntriesOfFile(int startBlock);
-int findAvailableBlockIndex();
-int findAvailableDirectoryEntryIndex();
-int allocateDirectoryEntry(int cacheIndex, char *filename, int size, int startBlock, int allocationStatus);
-int findAvailableOpenFileTableIndex();
-int findDirectoryEntryIndexByFilename(char *filename);
-void allocateOpenFileTableEntry(int fd, int cacheIndex, int accessMode);
-int allocateAvailableBlockForFile(int startBlock);
-int readFromBlockToBuffer(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter);
-int writeFromBufferToBlock(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter, int writeSize);
-void deallocateDirectoryEntry(int cacheIndex);
+int vsmkdir(char *dirname);
+int vsrmdir(char *dirname);
+int vsreaddir(char *dirname, struct vsDirent *entries, int maxEntries);
+int vssync();
+int vsgetblocksize();
+void vsgetiostats(struct vsIoStats *stats);
+void vsresetstats();
+int vssetcachesize(int blockCount);
+void vsgetcachestats(struct vsCacheStats *stats);
+int vssetflushpolicy(int policy, int intervalMs);
+int vssetallocationwindow(int blockCount);
+void vsfragreport();
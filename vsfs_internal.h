@@ -0,0 +1,160 @@
+// Helpers of vsfs.c, programs use the vs* and vsfs* calls of vsfs.h only
+#include "vsfs.h"
+
+struct dirEntry;
+struct fileStruct;
+struct fatPage;
+struct cacheBlock;
+struct asyncRequest;
+struct asyncOperation;
+
+int formatDisk(char *vdiskname, unsigned int m, int formatMode, int newBlockSize);
+struct vsfs *createDisk();
+void destroyDisk(struct vsfs *fs);
+struct vsfs *selectDisk(struct vsfs *fs);
+struct dirEntry *lockFileOfDescriptor(int fd, int exclusive);
+struct dirEntry *lockFileForReading(int fd);
+void unlockFileForReading(int fd, struct dirEntry *tmpDirEntry);
+int createPath(char *path, int type);
+int flushDelayedAppends(int fd);
+void flushAllDelayedAppends();
+int createFile(char *filename, int type);
+int openFile(char *file, int mode);
+int closeFile(int fd);
+int readFromFile(int fd, void *buf, int n, int offset);
+int readFromFileAsync(int fd, char *buf, int n, int offset, struct asyncRequest *request);
+int createReadView(int fd, int n, struct iovec **iov, int *cnt);
+int createCopiedView(int fd, int n, struct iovec **iov, int *cnt);
+int reserveViewPins(int blockCount);
+void releaseViewPins(int blockCount);
+void releaseReadView(int fd);
+int appendToFile(int fd, void *buf, int n, struct asyncRequest *request);
+int delayAppend(int fd, void *buf, int n);
+int writeDelayedAppends(int fd);
+void releaseDelayedAppends(struct dirEntry *tmpDirEntry, int freeData);
+int writeToFile(int fd, void *buf, int n, struct asyncRequest *request);
+int moveInlineDataToBlock(int cacheIndex);
+int deleteFile(char *filename);
+int removeDirectory(char *dirname);
+int readDirectory(char *dirname, struct vsDirent *entries, int maxEntries);
+void initializeSuperBlock(int blockCount, char *block);
+int initializeFatBlock(int fatBlock, int diskBlockCount, char *block);
+int initializeMetadataBlocks(int diskBlockCount);
+void cacheFatTable();
+int cacheRootDirectory();
+int addDirectoryBlock(int block);
+int growDirectory();
+void destroyDirectory();
+void cacheFileTail(int cacheIndex);
+int flushDirtyMetadataBlocks(char *dirtyBits, int blockCount, int firstBlock, int *homeBlocks, void (*fillBlock)(int, char *));
+int flushMetadata();
+void releaseCommittedBlocks(int committed);
+void serializeDirectoryEntry(int cacheIndex, char *entry);
+int collectJournalRecords();
+int applyJournalRecords(char *records, int length);
+unsigned int journalChecksum(char *data, int length, int sequence);
+int commitJournalTransaction(int recordBytes);
+int checkpointJournal();
+int loadJournaledMetadata();
+int loadJournaledDirectory(int readFromDisk);
+int reserveJournaledDirectory(int blockCount);
+int reserveJournalBuffer(size_t size);
+int replayJournal();
+int syncVirtualDisk();
+void *flushThreadMain(void *arg);
+void startFlushThread();
+void stopFlushThread();
+void clearOpenFileTable();
+int growOpenFileTable();
+void destroyOpenFileTable();
+struct fileStruct *getOpenFile(int fd);
+int isOpenDescriptor(int fd);
+int getSuperblock();
+int setSuperblock();
+int setBlockSize(int size);
+void setDiskLayout(int fatBlocks);
+int allocateBlockFatEntry(int cacheIndex, int data);
+int allocateAndAppendAvailableBlock(int startBlock);
+int findBlockOfFile(int fd, int logicalBlock);
+void addSkipIndexSample(struct dirEntry *tmpDirEntry, int sample, int block);
+void releaseSkipIndex(struct dirEntry *tmpDirEntry);
+void deallocateFatEntriesOfFile(int startBlock);
+int getRegionPageCount(int region);
+int countRegionFreeBlocks(int region);
+void updateFreeSummary(int block, int delta);
+void forgetFreeSummary(int onlyEmpty);
+int findNextFreeBlock(int from, int to, int useSummary);
+int countFreeRun(int start, int limit);
+int findAvailableBlockRun(int goal, int wanted, int *runLength);
+int createFatTable();
+void destroyFatTable();
+struct fatPage *getFatPage(int fatBlock);
+struct fatPage *loadFatPage(int fatBlock);
+int getFatEntry(int block);
+void setFatEntry(int block, int data);
+int getJournaledFatEntry(int block);
+void buildFreeBlockBits(struct fatPage *page);
+unsigned long long getFreeBlockWord(int word);
+void setBlockFreeBit(int block, int isFree);
+struct dirEntry *getDirectoryEntry(int cacheIndex);
+int findAvailableDirectoryEntryIndex();
+int allocateDirectoryEntry(int cacheIndex, char *filename, int size, int startBlock, int allocationStatus, int parent, int type);
+int resizeDirectoryEntry(int cacheIndex, int size, int startBlock);
+int findAvailableOpenFileTableIndex();
+int isRootPath(char *path);
+int resolveParentDirectory(char *path, int *parentIndex, char *name);
+int findDirectoryEntryIndexByPath(char *path);
+int findChildEntryIndex(int parentIndex, char *name);
+unsigned int hashFilename(int parentIndex, char *filename);
+void insertFilenameIndex(int cacheIndex);
+void removeFilenameIndex(int cacheIndex);
+int buildFilenameIndex();
+int rehashFilenameIndex(int size);
+int *findChildList(int parentIndex);
+void linkChildEntry(int cacheIndex);
+void unlinkChildEntry(int cacheIndex);
+void allocateOpenFileTableEntry(int fd, int cacheIndex, int accessMode);
+int allocateBlockRunForFile(int cacheIndex, int blockCount);
+void releaseNewBlockRuns(struct dirEntry *tmpDirEntry, int firstNewBlock, int oldLastBlock, int oldBlockCount, int reserved);
+void fillFatBlock(int fatBlock, char *block);
+void fillRootDirectoryBlock(int dirBlock, char *block);
+void copySpan(char *destination, char *source, int length);
+int readFromBlockToBuffer(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter);
+int readBlockRunToBuffer(char *blockBuffer, int block, int count);
+int writeBufferToBlockRun(char *blockBuffer, int block, int count);
+int writeFromBufferToBlock(char *blockBuffer, int block, int startOffset, int endOffset, int *byteCounter, int writeSize);
+void deallocateDirectoryEntry(int cacheIndex);
+void markDirectoryBlockDirty(int dirBlock);
+int mapVirtualDisk();
+void unmapVirtualDisk();
+char *getMappedBlock(int block);
+void markMappedRangeDirty(size_t offset, size_t length);
+int flushMappedDisk();
+int flushDirtyData();
+int initializeBufferCache();
+void destroyBufferCache();
+struct cacheBlock **findCacheBucket(int block);
+void removeFromCacheBucket(struct cacheBlock *entry);
+void moveToLruHead(struct cacheBlock *entry);
+struct cacheBlock *findCachedBlock(int block);
+struct cacheBlock *getCachedBlock(int block, int readFromDisk);
+void releaseCachedBlock(struct cacheBlock *entry);
+void invalidateCachedBlock(int block);
+int compareCacheBlocks(const void *a, const void *b);
+int flushBufferCache();
+struct asyncRequest *createAsyncRequest(struct dirEntry *tmpDirEntry, int isWrite, void *userData);
+int finishAsyncRequest(struct asyncRequest *request, int result);
+void releaseAsyncRequest(struct asyncRequest *request);
+void postAsyncRequest(struct asyncRequest *request);
+int submitAsyncOperation(struct asyncRequest *request, char *buffer, int block, int count, char *copyTo, int copyOffset, int copyLength);
+void completeAsyncOperation(struct asyncOperation *operation, int res);
+int reapAsyncCompletions();
+void waitAsyncProgress();
+void waitForAsyncWrites(struct dirEntry *tmpDirEntry);
+int queueRingOperation(struct asyncOperation *operation);
+int setupAsyncRing();
+void destroyAsyncRing();
+int startAsyncBackend();
+void stopAsyncBackend();
+void *asyncThreadMain(void *arg);
+int copyCachedSpan(char *destination, int block, int startOffset, int length);